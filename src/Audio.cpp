@@ -22,14 +22,35 @@
 
 #include <AL/al.h>
 #include <AL/alc.h>
+#include <atomic>
 #include <vector>
 #include <stdio.h>
 #include "Audio.h"
 
+// Streaming from a Web Audio worklet needs the wasm memory to be shared with it, as in pthreads builds
+#ifdef __EMSCRIPTEN_PTHREADS__
+#include <emscripten.h>
+#include <emscripten/html5.h>
+#include <emscripten/webaudio.h>
+#include "SampleRing.h"
+
+const int STREAM_QUANTUM = 128; // Samples per channel in each Web Audio process call
+
+SampleRing* streamRing = nullptr;
+EMSCRIPTEN_WEBAUDIO_T streamContext;
+unsigned char streamStack[4096] __attribute__((aligned(16)));
+
+EM_BOOL StreamProcess(int numInputs, const AudioSampleFrame* inputs, int numOutputs, AudioSampleFrame* outputs, int numParams, const AudioParamFrame* params, void* userData);
+void StreamThreadStarted(EMSCRIPTEN_WEBAUDIO_T context, EM_BOOL success, void* userData);
+void StreamProcessorCreated(EMSCRIPTEN_WEBAUDIO_T context, EM_BOOL success, void* userData);
+EM_BOOL StreamResumeCallback(int eventType, const EmscriptenKeyboardEvent* e, void* userData);
+#endif
+
 ALCdevice* dev;
 ALCcontext* ctx;
 ALuint source;
 std::vector<ALuint> freeBuffers;
+std::atomic<bool> streaming(false);
 
 void Audio::Init(int numBuffers)
 {
@@ -72,4 +93,92 @@ bool Audio::QueueBuffer(short* samples, int numSamples)
         alSourcePlay(source);
 
     return true;
-}
\ No newline at end of file
+}
+
+bool Audio::StartStream(SampleRing* ring)
+{
+#ifdef __EMSCRIPTEN_PTHREADS__
+    EmscriptenWebAudioCreateAttributes attributes;
+    attributes.latencyHint = "interactive";
+    attributes.sampleRate = 44100;
+    streamContext = emscripten_create_audio_context(&attributes);
+    if (!streamContext)
+        return false;
+
+    // The worklet is set up asynchronously. Samples wait in the ring until it starts playing them, or are queued as
+    // buffers again if the setup fails
+    streamRing = ring;
+    streaming = true;
+    emscripten_start_wasm_audio_worklet_thread_async(streamContext, streamStack, sizeof streamStack, StreamThreadStarted, nullptr);
+    // Browsers only let audio start after user input
+    emscripten_set_keydown_callback(EMSCRIPTEN_EVENT_TARGET_DOCUMENT, 0, 1, StreamResumeCallback);
+    return true;
+#else
+    (void)ring;
+    return false;
+#endif
+}
+
+bool Audio::IsStreaming()
+{
+    return streaming;
+}
+
+#ifdef __EMSCRIPTEN_PTHREADS__
+void StreamThreadStarted(EMSCRIPTEN_WEBAUDIO_T context, EM_BOOL success, void* /*userData*/)
+{
+    if (!success)
+    {
+        streaming = false;
+        return;
+    }
+
+    WebAudioWorkletProcessorCreateOptions options = { "sid", 0, nullptr };
+    emscripten_create_wasm_audio_worklet_processor_async(context, &options, StreamProcessorCreated, nullptr);
+}
+
+void StreamProcessorCreated(EMSCRIPTEN_WEBAUDIO_T context, EM_BOOL success, void* /*userData*/)
+{
+    if (!success)
+    {
+        streaming = false;
+        return;
+    }
+
+    int outputChannels = 1;
+    EmscriptenAudioWorkletNodeCreateOptions options = { 0, 1, &outputChannels };
+    EMSCRIPTEN_AUDIO_WORKLET_NODE_T node = emscripten_create_wasm_audio_worklet_node(context, "sid", &options, StreamProcess, nullptr);
+    if (!node)
+    {
+        streaming = false;
+        return;
+    }
+    EM_ASM({ emscriptenGetAudioObject($0).connect(emscriptenGetAudioObject($1).destination); }, node, context);
+}
+
+EM_BOOL StreamProcess(int /*numInputs*/, const AudioSampleFrame* /*inputs*/, int numOutputs, AudioSampleFrame* outputs, int /*numParams*/, const AudioParamFrame* /*params*/, void* /*userData*/)
+{
+    short samples[STREAM_QUANTUM];
+    unsigned numSamples = streamRing->Read(samples, STREAM_QUANTUM);
+
+    // Play silence if the ring runs dry
+    for (int i = 0; i < numOutputs; ++i)
+    {
+        for (int j = 0; j < outputs[i].numberOfChannels; ++j)
+        {
+            float* data = outputs[i].data + j * STREAM_QUANTUM;
+            for (unsigned k = 0; k < STREAM_QUANTUM; ++k)
+                data[k] = k < numSamples ? samples[k] / 32768.0f : 0.0f;
+        }
+    }
+
+    return EM_TRUE;
+}
+
+EM_BOOL StreamResumeCallback(int /*eventType*/, const EmscriptenKeyboardEvent* /*e*/, void* /*userData*/)
+{
+    if (emscripten_audio_context_state(streamContext) != AUDIO_CONTEXT_STATE_RUNNING)
+        emscripten_resume_audio_context_sync(streamContext);
+    return 0;
+}
+#endif
\ No newline at end of file
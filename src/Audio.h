@@ -22,10 +22,17 @@
 
 #pragma once
 
+class SampleRing;
+
 class Audio
 {
 public:
     static void Init(int numBuffers);
     static int NumFreeBuffers();
     static bool QueueBuffer(short* samples, int numSamples);
+    // Let the audio device pull samples from the ring on its own thread, so that a slow frame does not starve it.
+    // Return false if the backend can not, in which case samples are queued as buffers
+    static bool StartStream(SampleRing* ring);
+    // Return whether the device is pulling samples. Setup may finish asynchronously, and this turns false if it fails
+    static bool IsStreaming();
 };
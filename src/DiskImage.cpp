@@ -21,8 +21,8 @@
 // SOFTWARE.
 
 #include <stdio.h>
-#include <emscripten.h>
 #include "DiskImage.h"
+#include "SaveData.h"
 
 FileHandle::FileHandle() :
     track(0),
@@ -51,11 +51,8 @@ void FileHandle::Close()
         fclose(writer);
         writer = nullptr;
 
-        // When a file written to is closed, begin sync to persistent file system
-        EM_ASM(
-            FS.syncfs(false, function(err) {
-            });
-        );
+        // When a file written to is closed, sync to persistent storage
+        SaveData::Sync();
     }
     track = 0;
 }
@@ -67,26 +64,42 @@ int DiskImage::_d64SectorsPerTrack[] = {
     17,17,17,17,17
 };
 
-DiskImage::DiskImage(const std::string& name)
+DiskImage::DiskImage(const std::string& directory, const std::string& name) :
+    _type(D64)
 {
-    std::string imagePath = "diskimages/" + name;
+    std::string imagePath = directory;
+    if (!imagePath.empty() && imagePath[imagePath.length() - 1] != '/')
+        imagePath += '/';
+    imagePath += name;
 
     FILE* imageFile = fopen(imagePath.c_str(), "rb");
     if (imageFile)
     {
         fseek(imageFile, 0, SEEK_END);
-        int length = ftell(imageFile);
-        _data.resize(length);
+        long length = ftell(imageFile);
         fseek(imageFile, 0, SEEK_SET);
-        fread(&_data[0], length, 1, imageFile);
-        fclose(imageFile);
 
-        _name = name;
+        // The sector table assumes a full image, so other sizes are rejected rather than read out of bounds.
+        // A D81 image may have error bytes appended
         _type = length == 174848 ? D64 : D81;
-        printf("Opened disk image %s, size %d\n", name.c_str(), length);
+        if (length == 174848 || (length >= 819200 && length <= 822400))
+        {
+            _data.resize(length);
+            if (fread(&_data[0], length, 1, imageFile) != 1)
+                _data.clear();
+        }
+        fclose(imageFile);
+
+        if (IsLoaded())
+        {
+            _name = name;
+            printf("Opened disk image %s, size %ld\n", imagePath.c_str(), length);
+        }
+        else
+            printf("Failed to read disk image %s, size %ld\n", imagePath.c_str(), length);
     }
     else
-        printf("Failed to open disk image %s\n", name.c_str());
+        printf("Failed to open disk image %s\n", imagePath.c_str());
 
     MakeSectorTable();
 }
@@ -107,6 +120,9 @@ FileHandle DiskImage::OpenFileForWrite(const std::vector<unsigned char>& fileNam
 
 FileHandle DiskImage::OpenFile(const std::vector<unsigned char>& fileName)
 {
+    if (!IsLoaded())
+        return FileHandle();
+
     // Check for savefile
     FILE* saveFile = fopen(GetSaveFileName(fileName).c_str(), "rb");
     if (saveFile)
@@ -210,7 +226,12 @@ void DiskImage::WriteByte(FileHandle& handle, unsigned char value)
 
 std::string DiskImage::GetSaveFileName(const std::vector<unsigned char>& fileName)
 {
-    std::string filePath = "/savedata/" + _name;
+    // No save directory means saving is disabled
+    std::string filePath = SaveData::Directory();
+    if (filePath.empty())
+        return filePath;
+
+    filePath += _name;
     for (unsigned i = 0; i < fileName.size(); ++i)
         filePath += (char)fileName[i];
     return filePath;
@@ -52,7 +52,8 @@ public:
 class DiskImage
 {
 public:
-    DiskImage(const std::string& name);
+    DiskImage(const std::string& directory, const std::string& name);
+    bool IsLoaded() const { return !_data.empty(); }
     FileHandle OpenFileForWrite(const std::vector<unsigned char>& fileName);
     FileHandle OpenFile(const std::vector<unsigned char>& fileName);
     unsigned char ReadByte(FileHandle& handle);
@@ -31,23 +31,33 @@
 
 std::string diskImageName = "steelrangerdemo";
 
-Emulator::Emulator(const std::string& imageName) :
+Emulator::Emulator(const std::string& imageName, const std::string& imageDirectory) :
     _ram(nullptr),
     _processor(nullptr),
     _vic2(nullptr),
     _sid(nullptr),
     _disk(nullptr),
     _timer(0),
+    _timerCycles(0),
     _timerIRQEnable(false),
-    _timerIRQFlag(false)
+    _timerIRQFlag(false),
+    _booted(false)
 {
     if (imageName.length())
         diskImageName = imageName;
 
-    _ram = new RAM64K(*this);
+    _ram = new RAM64K();
     _processor = new MOS6502(*_ram, *this);
     _vic2 = new VIC2(*_ram);
-    _sid = new SID(*_ram);
+    _sid = new SID();
+
+    // CIA1 keyboard, joystick and timer, raster IRQ registers and SID writes for audio rendering
+    _ram->RegisterIORead(0xdc00, 0xdc01, this);
+    _ram->RegisterIORead(0xdc0d, 0xdc0d, this);
+    _ram->RegisterIOWrite(0xd011, 0xd012, this);
+    _ram->RegisterIOWrite(0xd01a, 0xd01a, this);
+    _ram->RegisterIOWrite(0xd400, 0xd418, this);
+    _ram->RegisterIOWrite(0xdc0d, 0xdc0e, this);
     for (int i = 0; i < 8; ++i)
         _keyMatrix[i] = 0xff;
 
@@ -98,7 +108,7 @@ Emulator::Emulator(const std::string& imageName) :
     Screen::Init();
     Audio::Init(5);
     InitMemory();
-    BootGame();
+    _booted = BootGame(imageDirectory);
 }
 
 Emulator::~Emulator()
@@ -107,12 +117,34 @@ Emulator::~Emulator()
     delete _ram;
     delete _vic2;
     delete _sid;
+    delete _disk;
 }
 
 void Emulator::Update()
 {
     RunFrame();
-    Screen::Redraw(_vic2->Pixels());
+    _vic2->EndFrame();
+    Screen::Redraw(_vic2->Pixels(), _vic2->DirtyLines());
+    _vic2->BeginRender();
+}
+
+void Emulator::SetJITEnabled(bool enable)
+{
+    _processor->SetJITEnabled(enable);
+}
+
+void Emulator::SetRenderMode(RenderMode mode)
+{
+    _vic2->SetRenderMode(mode);
+}
+
+void Emulator::SetAudioThreaded(bool enable)
+{
+    _sid->SetThreaded(enable);
+
+    // With synthesis off the frame critical path, let the audio device pull the samples as it plays them
+    if (_sid->IsThreaded() && !Audio::IsStreaming())
+        Audio::StartStream(_sid->Output());
 }
 
 void Emulator::InitMemory()
@@ -127,142 +159,211 @@ void Emulator::InitMemory()
     _ram->WriteIO(0xdc00, 0xff);
 }
 
-void Emulator::BootGame()
+// Load the first file on the disk image and point the RESET vector at it. Return false if there is nothing to boot
+bool Emulator::BootGame(const std::string& imageDirectory)
 {
-    _disk = new DiskImage(diskImageName);
+    _disk = new DiskImage(imageDirectory, diskImageName);
 
     // No filename, open first file in directory
     FileHandle bootFile = _disk->OpenFile(std::vector<unsigned char>());
-    if (bootFile.IsOpen())
+    if (!bootFile.IsOpen())
+        return false;
+
+    unsigned short loadAddress = (_disk->ReadByte(bootFile) + _disk->ReadByte(bootFile) * 256);
+    unsigned short address = loadAddress;
+    while (bootFile.IsOpen())
+        _ram->WriteRAM(address++, _disk->ReadByte(bootFile));
+
+    // Set end address on zero page
+    _ram->WriteRAM(0x2d, address & 0xff);
+    _ram->WriteRAM(0x2e, address >> 8);
+    _ram->WriteRAM(0xae, address & 0xff);
+    _ram->WriteRAM(0xaf, address >> 8);
+
+    // Set RESET vector to CLALL (autostart), otherwise assume sys2061
+    if (loadAddress <= 0x32c)
     {
-        unsigned short loadAddress = (_disk->ReadByte(bootFile) + _disk->ReadByte(bootFile) * 256);
-        unsigned short address = loadAddress;
-        while (bootFile.IsOpen())
-            _ram->WriteRAM(address++, _disk->ReadByte(bootFile));
-
-        // Set end address on zero page
-        _ram->WriteRAM(0x2d, address & 0xff);
-        _ram->WriteRAM(0x2e, address >> 8);
-        _ram->WriteRAM(0xae, address & 0xff);
-        _ram->WriteRAM(0xaf, address >> 8);
-
-        // Set RESET vector to CLALL (autostart), otherwise assume sys2061
-        if (loadAddress <= 0x32c)
-        {
-            _ram->WriteRAM(0xfffc, _ram->ReadRAM(0x32c));
-            _ram->WriteRAM(0xfffd, _ram->ReadRAM(0x32d));
-        }
-        else
-        {
-            _ram->WriteRAM(0xfffc, 0xd);
-            _ram->WriteRAM(0xfffd, 0x8);
-        }
+        _ram->WriteRAM(0xfffc, _ram->ReadRAM(0x32c));
+        _ram->WriteRAM(0xfffd, _ram->ReadRAM(0x32d));
+    }
+    else
+    {
+        _ram->WriteRAM(0xfffc, 0xd);
+        _ram->WriteRAM(0xfffd, 0x8);
     }
+
+    return true;
 }
 
 void Emulator::RunFrame()
 {
     const int frameCycles = CYCLES_PER_LINE * NUM_LINES;
-    _audioCycles = 0;
+    // Line 0 starts at the same cycle as line 1, so the CPU runs one line less per frame
+    const int frameCPUCycles = CYCLES_PER_LINE * (NUM_LINES - 1);
 
     _processor->SetCycles(0);
+    _vic2->SetRasterLine(0);
+    ScheduleEvent(EventLineEnd, 0);
+    ScheduleRasterCompare(0);
 
-    for (unsigned i = 0; i < FIRST_VISIBLE_LINE; ++i)
-        ExecuteLine(i, false);
-
-    _vic2->BeginFrame();
+    // Run the CPU until the next event, then handle all events that are due
+    bool frameDone = false;
+    while (!frameDone)
+    {
+        _processor->RunUntil(_scheduler.NextEventCycle());
 
-    for (unsigned i = FIRST_VISIBLE_LINE; i < FIRST_INVISIBLE_LINE; ++i)
-        ExecuteLine(i, true);
+        EventType type;
+        while (_scheduler.PopEvent(_processor->Cycles(), type))
+        {
+            if (!HandleEvent(type))
+                frameDone = true;
+        }
+    }
 
-    for (unsigned i = FIRST_INVISIBLE_LINE; i < NUM_LINES; ++i)
-        ExecuteLine(i, false);
+    // Render the frame's audio, replaying the SID writes
+    _sid->EndFrame(frameCycles);
 
-    // Render rest of audio until end of frame
-    if (_audioCycles < frameCycles)
-    {
-        _sid->BufferSamples(frameCycles - _audioCycles);
-        _audioCycles = frameCycles;
-    }
+    // Events that did not happen yet carry over to the next frame
+    _scheduler.Cancel(EventRasterCompare);
+    _scheduler.Rebase(frameCPUCycles);
+    _timerCycles -= frameCPUCycles;
 }
 
-void Emulator::QueueAudio()
+// Handle a due event. Return false when the frame is complete
+bool Emulator::HandleEvent(EventType type)
 {
-    unsigned frameSamples = 44100 / 50;
-
-    while (_sid->samples.size() > frameSamples && Audio::NumFreeBuffers() > 0)
+    switch (type)
     {
-        Audio::QueueBuffer(&_sid->samples[0], frameSamples);
-        _sid->samples.erase(_sid->samples.begin(), _sid->samples.begin() + frameSamples);
+        case EventLineEnd:
+            {
+                int lineNum = _vic2->RasterLine();
+                if (lineNum >= FIRST_VISIBLE_LINE && lineNum < FIRST_INVISIBLE_LINE)
+                    _vic2->RenderNextLine();
+                if (lineNum + 1 >= NUM_LINES)
+                    return false;
+
+                ++lineNum;
+                if (lineNum == FIRST_VISIBLE_LINE)
+                    _vic2->BeginFrame();
+                _vic2->SetRasterLine(lineNum);
+                ScheduleEvent(EventLineEnd, CYCLES_PER_LINE * lineNum);
+            }
+            break;
+
+        case EventRasterCompare:
+            _processor->SetIRQ();
+            break;
+
+        case EventTimerA:
+            _timer = 0;
+            _timerCycles = _processor->Cycles();
+            if (_timerIRQEnable)
+            {
+                _timerIRQFlag = true;
+                _processor->SetIRQ();
+            }
+            break;
+
+        default:
+            break;
     }
+
+    return true;
 }
 
-void Emulator::ExecuteLine(int lineNum, bool visible)
+void Emulator::ScheduleEvent(EventType type, int cycle)
 {
-    UpdateLineCounterAndIRQ(lineNum);
-
-    int targetCycles = CYCLES_PER_LINE * lineNum;
-
-    while (_processor->Cycles() < targetCycles && !_processor->Jam())
-        _processor->Process();
+    _scheduler.Schedule(type, cycle);
+    // Stop the CPU in time if it is running
+    _processor->LimitRun(cycle);
+}
 
-    if (visible)
-        _vic2->RenderNextLine();
+void Emulator::ScheduleRasterCompare(int minCycle, unsigned short writeAddress, unsigned char writeValue)
+{
+    // Schedule the raster IRQ to the start of the target line, if it is still ahead in this frame.
+    // I/O writes are hooked before the value changes, so the register being written is passed in
+    unsigned char irqMask = writeAddress == 0xd01a ? writeValue : _ram->ReadIO(0xd01a, false);
+    unsigned char control = writeAddress == 0xd011 ? writeValue : _ram->ReadIO(0xd011, false);
+    unsigned char rasterLine = writeAddress == 0xd012 ? writeValue : _ram->ReadIO(0xd012, false);
+
+    _scheduler.Cancel(EventRasterCompare);
+    if ((irqMask & 0x1) == 0)
+        return;
+
+    int targetLineNum = (control & 0x80) * 2 + rasterLine;
+    if (targetLineNum >= NUM_LINES)
+        return;
+
+    int cycle = targetLineNum > 0 ? CYCLES_PER_LINE * (targetLineNum - 1) : 0;
+    if (cycle >= minCycle)
+        ScheduleEvent(EventRasterCompare, cycle);
 }
 
-void Emulator::UpdateLineCounterAndIRQ(int lineNum)
+void Emulator::UpdateTimer()
 {
-    _lineCounter = lineNum;
-    if ((_ram->ReadIO(0xd01a, false) & 0x1) > 0)
-    {
-        int targetLineNum = (_ram->ReadIO(0xd011, false) & 0x80) * 2 + _ram->ReadIO(0xd012, false);
-        if (_lineCounter == targetLineNum)
-            _processor->SetIRQ();
-    }
+    // Count down the cycles elapsed since the last update, if the timer is running
+    int cycles = _processor->Cycles();
     if (_timer > 0 && (_ram->ReadIO(0xdc0e, false) & 0x1) > 0)
     {
-        _timer -= CYCLES_PER_LINE;
-        if (_timer <= 0)
-        {
+        _timer -= cycles - _timerCycles;
+        if (_timer < 0)
             _timer = 0;
-            if (_timerIRQEnable)
-            {
-                _timerIRQFlag = true;
-                _processor->SetIRQ();
-            }
-        }
+    }
+    _timerCycles = cycles;
+}
+
+void Emulator::QueueAudio()
+{
+    const unsigned frameSamples = 44100 / 50;
+    short buffer[frameSamples];
+
+    // The audio device reads the samples itself when streaming. If the stream failed to start they are queued here
+    if (Audio::IsStreaming())
+        return;
+
+    // Samples may be written by the audio thread at the same time
+    while (_sid->NumSamples() > frameSamples && Audio::NumFreeBuffers() > 0)
+    {
+        _sid->ReadSamples(buffer, frameSamples);
+        Audio::QueueBuffer(buffer, frameSamples);
     }
 }
 
 void Emulator::IOWrite(unsigned short address, unsigned char value)
 {
-    // Render audio up to the current point on each SID write
+    // Log SID writes, audio is rendered at the end of the frame
     if (address >= 0xd400 && address <= 0xd418)
+        _sid->Write(_processor->Cycles(), (unsigned char)(address - 0xd400), value);
+    else if (address == 0xd011 || address == 0xd012 || address == 0xd01a)
     {
-        _sid->BufferSamples(_processor->Cycles() - _audioCycles);
-        _audioCycles = _processor->Cycles();
+        _vic2->IOWrite(address, value);
+        // The current line was already compared at its start
+        ScheduleRasterCompare(_processor->Cycles() + 1, address, value);
     }
-    if (address == 0xdc0d)
+    else if (address == 0xdc0d)
     {
         if ((value & 0x81) == 0x81)
             _timerIRQEnable = true;
         if ((value & 0x81) == 0x1)
             _timerIRQEnable = false;
     }
-    if (address == 0xdc0e)
+    else if (address == 0xdc0e)
     {
+        UpdateTimer();
         if ((value & 0x10) > 0)
             _timer = _ram->ReadIO(0xdc04, false) | (_ram->ReadIO(0xdc05, false) << 8);
+
+        if (_timer > 0 && (value & 0x1) > 0)
+            ScheduleEvent(EventTimerA, _timerCycles + _timer);
+        else
+            _scheduler.Cancel(EventTimerA);
     }
 }
 
-unsigned char Emulator::IORead(unsigned short address, bool& handled)
+unsigned char Emulator::IORead(unsigned short address)
 {
-    handled = false;
-
     if (address == 0xdc00)
     {
-        handled = true;
         unsigned char joystick = 0x00;
         if (IsKeyDown(38)) joystick |= 0x1;
         if (IsKeyDown(40)) joystick |= 0x2;
@@ -273,7 +374,6 @@ unsigned char Emulator::IORead(unsigned short address, bool& handled)
     }
     else if (address == 0xdc01)
     {
-        handled = true;
         unsigned char ret = 0xff;
         for (int i = 0; i < 8; ++i)
         {
@@ -282,24 +382,9 @@ unsigned char Emulator::IORead(unsigned short address, bool& handled)
         }
         return ret;
     }
-    else if (address == 0xd011)
-    {
-        handled = true;
-        return (_lineCounter >= 0x100 ? 0x80 : 0x00) | (_ram->ReadIO(0xd011, false) & 0x7f);
-    }
-    else if (address == 0xd012)
-    {
-        handled = true;
-        return _lineCounter & 0xff;
-    }
-    else if (address == 0xd030)
-    {
-        handled = true;
-        return 0xff;
-    }
-    else if (address == 0xdc0d)
+    else
     {
-        handled = true;
+        // $dc0d interrupt control, reading acknowledges the timer interrupt
         unsigned char ret = 0x0;
         if (_timerIRQEnable) 
             ret |= 0x1;
@@ -310,11 +395,12 @@ unsigned char Emulator::IORead(unsigned short address, bool& handled)
         }
         return ret;
     }
-    else
-    {
-        handled = false;
-        return 0;
-    }
+}
+
+bool Emulator::IOReadIsStable(unsigned short address)
+{
+    // Keyboard and joystick only change between frames. Reading the interrupt control register acknowledges interrupts
+    return address == 0xdc00 || address == 0xdc01;
 }
 
 void Emulator::KernalTrap(unsigned short address)
@@ -25,32 +25,40 @@
 #include <map>
 #include <set>
 #include "DiskImage.h"
+#include "RAM64K.h"
+#include "Scheduler.h"
+#include "VIC2.h"
 
 class MOS6502;
-class RAM64K;
-class VIC2;
 class SID;
 
-class Emulator
+class Emulator : public IODevice
 {
 public:
-    Emulator(const std::string& imageName);
+    Emulator(const std::string& imageName, const std::string& imageDirectory = "diskimages");
     ~Emulator();
 
     void Update();
     void QueueAudio();
 
     void KernalTrap(unsigned short address);
-    unsigned char IORead(unsigned short address, bool& handled);
-    void IOWrite(unsigned short address, unsigned char value);
+    unsigned char IORead(unsigned short address) override;
+    void IOWrite(unsigned short address, unsigned char value) override;
+    bool IOReadIsStable(unsigned short address) override;
     void HandleKey(unsigned keyCode, bool down);
+    void SetJITEnabled(bool enable);
+    void SetRenderMode(RenderMode mode);
+    void SetAudioThreaded(bool enable);
+    bool IsBooted() const { return _booted; }
 
 private:
     void InitMemory();
-    void BootGame();
+    bool BootGame(const std::string& imageDirectory);
     void RunFrame();
-    void ExecuteLine(int lineNum, bool visible);
-    void UpdateLineCounterAndIRQ(int lineNum);
+    bool HandleEvent(EventType type);
+    void ScheduleEvent(EventType type, int cycle);
+    void ScheduleRasterCompare(int minCycle, unsigned short writeAddress = 0, unsigned char writeValue = 0);
+    void UpdateTimer();
     bool IsKeyDown(unsigned keyCode);
 
     RAM64K* _ram;
@@ -62,10 +70,11 @@ private:
     std::vector<unsigned char> _fileName;
     std::set<unsigned> _keysDown;
     std::map<unsigned, unsigned char> _keyMappings;
-    int _lineCounter;
-    int _audioCycles;
+    Scheduler _scheduler;
     int _timer;
+    int _timerCycles;
     bool _timerIRQEnable;
     bool _timerIRQFlag;
+    bool _booted;
     unsigned char _keyMatrix[8];
 };
@@ -0,0 +1,1051 @@
+// MIT License
+// 
+// Copyright (c) 2018-2026 Lasse Oorni
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "JIT.h"
+
+#ifdef JIT_SUPPORTED
+
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "RAM64K.h"
+
+// Compiled code keeps the CPU in rbx, the RAM in r15 and a computed effective address in r14d, as these survive calls.
+// The 6502 registers stay in the MOS6502 object. The prologue below is skipped when jumping from block to block
+const int JIT_PROLOGUE_SIZE = 18;
+
+enum Condition
+{
+    CondB = 0x2,
+    CondAE = 0x3,
+    CondE = 0x4,
+    CondNE = 0x5,
+    CondBE = 0x6,
+    CondGE = 0xd
+};
+
+// Register field of the immediate group and shift opcodes
+enum Extension
+{
+    ExtAdd = 0,
+    ExtOr = 1,
+    ExtAnd = 4,
+    ExtSub = 5,
+    ExtXor = 6,
+    ExtCmp = 7,
+    ExtShl = 4,
+    ExtShr = 5
+};
+
+// Register to register opcodes, with the destination in r/m
+enum AluOpcode
+{
+    OpAdd = 0x01,
+    OpOr = 0x09,
+    OpAnd = 0x21,
+    OpSub = 0x29,
+    OpXor = 0x31,
+    OpCmp = 0x39
+};
+
+enum SlowPathKind
+{
+    SlowRead = 0,
+    SlowWrite,
+    SlowPush,
+    SlowFallback,
+    SlowExit
+};
+
+// Memory accesses that cannot be done inline
+static unsigned ReadMemory(RAM64K* ram, unsigned address)
+{
+    return ram->Read((unsigned short)address);
+}
+
+static void WriteMemory(RAM64K* ram, unsigned address, unsigned value)
+{
+    ram->Write((unsigned short)address, (unsigned char)value);
+}
+
+static void WriteStack(RAM64K* ram, unsigned address, unsigned value)
+{
+    ram->WriteRAM((unsigned short)address, (unsigned char)value);
+}
+
+JIT::JIT(MOS6502& cpu, RAM64K& ram) :
+    _cpu(cpu),
+    _ram(ram),
+    _arena(nullptr),
+    _writableArena(nullptr),
+    _used(0),
+    _compiledBlocks(0),
+    _flushes(0),
+    _dispatchLabel(0),
+    _exitLabel(0)
+{
+    // The arena is mapped twice, writable for emitting code and executable for running it, so that compiling does not
+    // need to change page protections
+    int fd = memfd_create("jit", MFD_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    if (ftruncate(fd, JIT_ARENA_SIZE) == 0)
+    {
+        void* writable = mmap(nullptr, JIT_ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        void* executable = mmap(nullptr, JIT_ARENA_SIZE, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+        if (writable != MAP_FAILED && executable != MAP_FAILED)
+        {
+            _writableArena = (unsigned char*)writable;
+            _arena = (unsigned char*)executable;
+        }
+        else
+        {
+            if (writable != MAP_FAILED)
+                munmap(writable, JIT_ARENA_SIZE);
+            if (executable != MAP_FAILED)
+                munmap(executable, JIT_ARENA_SIZE);
+        }
+    }
+    close(fd);
+}
+
+JIT::~JIT()
+{
+    if (_arena)
+    {
+        munmap(_arena, JIT_ARENA_SIZE);
+        munmap(_writableArena, JIT_ARENA_SIZE);
+    }
+}
+
+JIT::BlockFunction JIT::Compile(const MOS6502::CodeBlock& block)
+{
+    _code.clear();
+    _labels.clear();
+    _fixups.clear();
+    _slowPaths.clear();
+    _dispatchLabel = NewLabel();
+    _exitLabel = NewLabel();
+
+    Push(RBX);
+    Push(R14);
+    Push(R15);
+    MovReg64(RBX, RDI);
+    MovRegImm64(R15, (unsigned long long)&_ram);
+
+    unsigned short pc = block.startAddress;
+    for (int i = 0; i < block.numOpcodes; ++i)
+    {
+        const MOS6502::DecodedOpcode& decoded = block.opcodes[i];
+        CompileOpcode(decoded, pc, i == block.numOpcodes - 1);
+        pc = (unsigned short)(pc + decoded.info->length);
+    }
+
+    // Idle loops are fast-forwarded by RunUntil after each run, so they must return to it
+    EmitDispatch(!block.idleLoop);
+
+    Bind(_exitLabel);
+    Pop(R15);
+    Pop(R14);
+    Pop(RBX);
+    Emit(0xc3); // ret
+
+    EmitSlowPaths();
+
+    for (unsigned i = 0; i < _fixups.size(); ++i)
+    {
+        int relative = _labels[_fixups[i].label] - (int)(_fixups[i].offset + 4);
+        memcpy(&_code[_fixups[i].offset], &relative, sizeof relative);
+    }
+
+    // Keep compiled code 16-byte aligned
+    unsigned size = (_code.size() + 15) & ~15;
+    if (!_arena || _used + size > JIT_ARENA_SIZE)
+        return nullptr;
+
+    memcpy(_writableArena + _used, &_code[0], _code.size());
+    BlockFunction function = (BlockFunction)(_arena + _used);
+    _used += size;
+    ++_compiledBlocks;
+    return function;
+}
+
+void JIT::Flush()
+{
+    _used = 0;
+    ++_flushes;
+}
+
+void JIT::CompileOpcode(const MOS6502::DecodedOpcode& decoded, unsigned short pc, bool last)
+{
+    const MOS6502::OpcodeInfo& info = *decoded.info;
+    unsigned char opcode = (unsigned char)(decoded.info - MOS6502::_opcodeTable);
+    unsigned short nextPC = (unsigned short)(pc + info.length);
+    int operation = decoded.operation;
+
+    if (operation == OperationFallback)
+    {
+        EmitFallback(opcode, pc, decoded.operand);
+        if (last)
+            Jmp(_dispatchLabel);
+        else
+            EmitExitCheck(nextPC, true);
+        return;
+    }
+
+    if (info.mode == ModeRelative)
+    {
+        CompileBranch(operation, decoded, nextPC);
+        return;
+    }
+
+    Mem a = CPU(&_cpu._a);
+    Mem x = CPU(&_cpu._x);
+    Mem y = CPU(&_cpu._y);
+    Mem sp = CPU(&_cpu._sp);
+    Mem flags = CPU(&_cpu._flags);
+    Mem zn = CPU(&_cpu._znResult);
+    Address address = { false, false, 0 };
+    unsigned short target = nextPC;
+    bool writes = false;
+    int done = NewLabel();
+
+    if (info.mode != ModeImplied && operation != OperationJMP && operation != OperationJSR)
+    {
+        if (operation == OperationADC || operation == OperationSBC)
+        {
+            // Decimal mode is rare, leave it to the interpreter
+            int decimal = AddSlowPath(SlowFallback, done, address);
+            _slowPaths.back().pc = pc;
+            _slowPaths.back().opcode = opcode;
+            _slowPaths.back().operand = decoded.operand;
+            TestMem8(flags, FLAG_DECIMAL);
+            Jcc(CondNE, decimal);
+        }
+        address = EmitEffectiveAddress(info, decoded.operand, pc);
+    }
+
+    // Results are computed into edx, which is also the value register for writes and pushes
+    switch (operation)
+    {
+        case OperationLDA:
+        case OperationLDX:
+        case OperationLDY:
+            EmitRead(address);
+            Store8(operation == OperationLDA ? a : (operation == OperationLDX ? x : y), RAX);
+            Store16(zn, RAX);
+            break;
+
+        case OperationSTA:
+        case OperationSTX:
+        case OperationSTY:
+            MovzxByte(RDX, operation == OperationSTA ? a : (operation == OperationSTX ? x : y));
+            EmitWrite(address);
+            writes = true;
+            break;
+
+        case OperationAND:
+        case OperationORA:
+        case OperationEOR:
+            EmitRead(address);
+            MovzxByte(RDX, a);
+            AluReg(operation == OperationAND ? OpAnd : (operation == OperationORA ? OpOr : OpXor), RDX, RAX);
+            Store8(a, RDX);
+            Store16(zn, RDX);
+            break;
+
+        case OperationADC:
+        case OperationSBC:
+            EmitRead(address);
+            // Binary subtraction is addition of the inverted operand
+            if (operation == OperationSBC)
+                AluRegImm(ExtXor, RAX, 0xff);
+            MovzxByte(RCX, a);
+            MovzxByte(RDX, flags);
+            AluRegImm(ExtAnd, RDX, FLAG_CARRY);
+            AluReg(OpAdd, RDX, RCX);
+            AluReg(OpAdd, RDX, RAX);
+            // Overflow if the operands have the same sign and the result's sign differs
+            AluReg(OpXor, RCX, RDX);
+            AluReg(OpXor, RAX, RDX);
+            AluReg(OpAnd, RCX, RAX);
+            AluRegImm(ExtAnd, RCX, 0x80);
+            ShiftRegImm(ExtShr, RCX, 1);
+            MovReg(RAX, RDX);
+            ShiftRegImm(ExtShr, RAX, 8);
+            AluReg(OpOr, RCX, RAX);
+            MovzxByte(RAX, flags);
+            AluRegImm(ExtAnd, RAX, 0xff & ~(FLAG_CARRY | FLAG_OVERFLOW));
+            AluReg(OpOr, RAX, RCX);
+            Store8(flags, RAX);
+            MovzxByteReg(RDX, RDX);
+            Store8(a, RDX);
+            Store16(zn, RDX);
+            break;
+
+        case OperationCMP:
+        case OperationCPX:
+        case OperationCPY:
+            EmitRead(address);
+            MovzxByte(RDX, operation == OperationCMP ? a : (operation == OperationCPX ? x : y));
+            AluReg(OpCmp, RDX, RAX);
+            Setcc(CondAE, RCX);
+            AluReg(OpSub, RDX, RAX);
+            MovzxByteReg(RDX, RDX);
+            Store16(zn, RDX);
+            AluMem8(ExtAnd, flags, 0xff & ~FLAG_CARRY);
+            OpMem(0x08, 1, false, RCX, flags, true); // or [flags], cl
+            break;
+
+        case OperationBIT:
+            EmitRead(address);
+            MovReg(RCX, RAX);
+            AluRegImm(ExtAnd, RCX, FLAG_OVERFLOW);
+            AluMem8(ExtAnd, flags, 0xff & ~FLAG_OVERFLOW);
+            OpMem(0x08, 1, false, RCX, flags, true); // or [flags], cl
+            // N comes from bit 7 of the operand, Z from the AND result
+            MovzxByte(RDX, a);
+            AluReg(OpAnd, RDX, RAX);
+            AluRegImm(ExtAnd, RAX, 0x80);
+            ShiftRegImm(ExtShl, RAX, 1);
+            AluReg(OpOr, RDX, RAX);
+            Store16(zn, RDX);
+            break;
+
+        case OperationINC:
+        case OperationDEC:
+            EmitRead(address);
+            MovReg(RDX, RAX);
+            AluRegImm(operation == OperationINC ? ExtAdd : ExtSub, RDX, 1);
+            MovzxByteReg(RDX, RDX);
+            Store16(zn, RDX);
+            EmitWrite(address);
+            writes = true;
+            break;
+
+        case OperationASL:
+        case OperationLSR:
+        case OperationROL:
+        case OperationROR:
+        case OperationASLAccumulator:
+        case OperationLSRAccumulator:
+        case OperationROLAccumulator:
+        case OperationRORAccumulator:
+            {
+                bool accumulator = operation >= OperationASLAccumulator;
+                int shift = accumulator ? operation - OperationASLAccumulator + OperationASL : operation;
+                bool left = shift == OperationASL || shift == OperationROL;
+
+                if (accumulator)
+                    MovzxByte(RAX, a);
+                else
+                    EmitRead(address);
+
+                // Shifted out bit to ecx, result to edx
+                MovReg(RCX, RAX);
+                MovReg(RDX, RAX);
+                if (left)
+                    ShiftRegImm(ExtShr, RCX, 7);
+                else
+                    AluRegImm(ExtAnd, RCX, 1);
+                ShiftRegImm(left ? ExtShl : ExtShr, RDX, 1);
+                if (shift == OperationROL || shift == OperationROR)
+                {
+                    MovzxByte(RAX, flags);
+                    AluRegImm(ExtAnd, RAX, FLAG_CARRY);
+                    if (!left)
+                        ShiftRegImm(ExtShl, RAX, 7);
+                    AluReg(OpOr, RDX, RAX);
+                }
+                MovzxByteReg(RDX, RDX);
+                AluMem8(ExtAnd, flags, 0xff & ~FLAG_CARRY);
+                OpMem(0x08, 1, false, RCX, flags, true); // or [flags], cl
+                Store16(zn, RDX);
+
+                if (accumulator)
+                    Store8(a, RDX);
+                else
+                {
+                    EmitWrite(address);
+                    writes = true;
+                }
+            }
+            break;
+
+        case OperationINX:
+        case OperationINY:
+        case OperationDEX:
+        case OperationDEY:
+            {
+                Mem reg = (operation == OperationINX || operation == OperationDEX) ? x : y;
+                AluMem8((operation == OperationINX || operation == OperationINY) ? ExtAdd : ExtSub, reg, 1);
+                MovzxByte(RDX, reg);
+                Store16(zn, RDX);
+            }
+            break;
+
+        case OperationTAX:
+        case OperationTAY:
+        case OperationTSX:
+        case OperationTXA:
+        case OperationTXS:
+        case OperationTYA:
+            {
+                Mem source = (operation == OperationTAX || operation == OperationTAY) ? a :
+                    (operation == OperationTSX ? sp : (operation == OperationTYA ? y : x));
+                Mem dest = (operation == OperationTAX || operation == OperationTSX) ? x :
+                    (operation == OperationTAY ? y : (operation == OperationTXS ? sp : a));
+                MovzxByte(RDX, source);
+                Store8(dest, RDX);
+                if (operation != OperationTXS)
+                    Store16(zn, RDX);
+            }
+            break;
+
+        case OperationCLC:
+            AluMem8(ExtAnd, flags, 0xff & ~FLAG_CARRY);
+            break;
+
+        case OperationSEC:
+            AluMem8(ExtOr, flags, FLAG_CARRY);
+            break;
+
+        case OperationCLV:
+            AluMem8(ExtAnd, flags, 0xff & ~FLAG_OVERFLOW);
+            break;
+
+        case OperationCLD:
+            AluMem8(ExtAnd, flags, 0xff & ~FLAG_DECIMAL);
+            break;
+
+        case OperationSED:
+            AluMem8(ExtOr, flags, FLAG_DECIMAL);
+            break;
+
+        case OperationSEI:
+            AluMem8(ExtOr, flags, FLAG_INTERRUPT);
+            break;
+
+        case OperationCLI:
+            AluMem8(ExtAnd, flags, 0xff & ~FLAG_INTERRUPT);
+            break;
+
+        case OperationNOP:
+            break;
+
+        case OperationPHA:
+            MovzxByte(RDX, a);
+            EmitPush();
+            writes = true;
+            break;
+
+        case OperationPHP:
+            // Same as MOS6502::Status()
+            MovzxByte(RDX, flags);
+            AluRegImm(ExtOr, RDX, 0x30);
+            MovzxWord(RAX, zn);
+            TestRegImm(RAX, 0xff);
+            Setcc(CondE, RCX);
+            MovzxByteReg(RCX, RCX);
+            ShiftRegImm(ExtShl, RCX, 1);
+            AluReg(OpOr, RDX, RCX);
+            TestRegImm(RAX, 0x180);
+            Setcc(CondNE, RCX);
+            MovzxByteReg(RCX, RCX);
+            ShiftRegImm(ExtShl, RCX, 7);
+            AluReg(OpOr, RDX, RCX);
+            EmitPush();
+            writes = true;
+            break;
+
+        case OperationPLA:
+            EmitPop();
+            Store8(a, RAX);
+            Store16(zn, RAX);
+            break;
+
+        case OperationJMP:
+            target = decoded.operand;
+            break;
+
+        case OperationJSR:
+            MovRegImm(RDX, (unsigned short)(nextPC - 1) >> 8);
+            EmitPush();
+            MovRegImm(RDX, (unsigned short)(nextPC - 1) & 0xff);
+            EmitPush();
+            target = decoded.operand;
+            writes = true;
+            break;
+
+        case OperationRTS:
+            EmitPop();
+            MovReg(RSI, RAX);
+            EmitPop();
+            ShiftRegImm(ExtShl, RAX, 8);
+            AluReg(OpOr, RAX, RSI);
+            AluRegImm(ExtAdd, RAX, 1);
+            Store16(CPU(&_cpu._pc), RAX);
+            break;
+
+        default:
+            break;
+    }
+
+    AluMem32(ExtAdd, CPU(&_cpu._cycles), info.cycles);
+    Bind(done);
+
+    if (last)
+    {
+        if (operation != OperationRTS)
+            StoreImm16(CPU(&_cpu._pc), target);
+        Jmp(_dispatchLabel);
+    }
+    else
+        EmitExitCheck(nextPC, writes);
+}
+
+void JIT::CompileBranch(int operation, const MOS6502::DecodedOpcode& decoded, unsigned short nextPC)
+{
+    Mem flags = CPU(&_cpu._flags);
+    Mem zn = CPU(&_cpu._znResult);
+    unsigned short target = (unsigned short)(nextPC + (signed char)decoded.operand);
+    int cycles = decoded.info->cycles;
+    int taken = NewLabel();
+
+    switch (operation)
+    {
+        case OperationBCC:
+        case OperationBCS:
+            TestMem8(flags, FLAG_CARRY);
+            Jcc(operation == OperationBCC ? CondE : CondNE, taken);
+            break;
+
+        case OperationBEQ:
+        case OperationBNE:
+            TestMem8(zn, 0xff);
+            Jcc(operation == OperationBEQ ? CondE : CondNE, taken);
+            break;
+
+        case OperationBMI:
+        case OperationBPL:
+            TestMem16(zn, 0x180);
+            Jcc(operation == OperationBMI ? CondNE : CondE, taken);
+            break;
+
+        default:
+            TestMem8(flags, FLAG_OVERFLOW);
+            Jcc(operation == OperationBVC ? CondE : CondNE, taken);
+            break;
+    }
+
+    AluMem32(ExtAdd, CPU(&_cpu._cycles), cycles);
+    StoreImm16(CPU(&_cpu._pc), nextPC);
+    Jmp(_dispatchLabel);
+
+    // A taken branch costs one cycle more, two if it crosses a page
+    Bind(taken);
+    AluMem32(ExtAdd, CPU(&_cpu._cycles), cycles + 1 + (((nextPC ^ target) & 0xff00) ? 1 : 0));
+    StoreImm16(CPU(&_cpu._pc), target);
+    Jmp(_dispatchLabel);
+}
+
+JIT::Address JIT::EmitEffectiveAddress(const MOS6502::OpcodeInfo& info, unsigned short operand, unsigned short pc)
+{
+    Address address = { false, false, operand };
+    Mem x = CPU(&_cpu._x);
+    Mem y = CPU(&_cpu._y);
+
+    switch (info.mode)
+    {
+        case ModeImmediate:
+            // Read at execution time like the interpreter does, so that self-modified immediates work
+            address.value = (unsigned short)(pc + 1);
+            break;
+
+        case ModeZeroPage:
+            address.zeroPage = true;
+            break;
+
+        case ModeZeroPageX:
+        case ModeZeroPageY:
+            MovzxByte(R14, info.mode == ModeZeroPageX ? x : y);
+            AluRegImm(ExtAdd, R14, operand & 0xff);
+            MovzxByteReg(R14, R14);
+            address.dynamic = true;
+            address.zeroPage = true;
+            break;
+
+        case ModeAbsoluteX:
+        case ModeAbsoluteY:
+            MovzxByte(R14, info.mode == ModeAbsoluteX ? x : y);
+            if (info.pageCrossPenalty)
+            {
+                MovRegImm(RCX, operand & 0xff);
+                EmitPageCrossCycle(R14, RCX);
+            }
+            AluRegImm(ExtAdd, R14, operand);
+            MovzxWordReg(R14, R14);
+            address.dynamic = true;
+            break;
+
+        case ModeIndirectX:
+            // Zero page pointers are read without wrapping at $ff, like MOS6502::ReadZeroPage16
+            MovzxByte(RCX, x);
+            AluRegImm(ExtAdd, RCX, operand & 0xff);
+            MovzxByteReg(RCX, RCX);
+            MovzxByte(R14, RAM(&_ram._ram[0], RCX));
+            MovzxByte(RAX, RAM(&_ram._ram[1], RCX));
+            ShiftRegImm(ExtShl, RAX, 8);
+            AluReg(OpOr, R14, RAX);
+            address.dynamic = true;
+            break;
+
+        case ModeIndirectY:
+            MovzxByte(R14, RAM(&_ram._ram[operand & 0xff]));
+            MovzxByte(RAX, RAM(&_ram._ram[(operand & 0xff) + 1]));
+            ShiftRegImm(ExtShl, RAX, 8);
+            AluReg(OpOr, R14, RAX);
+            MovzxByte(RAX, y);
+            if (info.pageCrossPenalty)
+            {
+                MovzxByteReg(RCX, R14);
+                EmitPageCrossCycle(RAX, RCX);
+            }
+            AluReg(OpAdd, R14, RAX);
+            MovzxWordReg(R14, R14);
+            address.dynamic = true;
+            break;
+
+        default:
+            break;
+    }
+
+    return address;
+}
+
+void JIT::EmitPageCrossCycle(int indexReg, int lowReg)
+{
+    // The extra cycle is counted before the access, like MOS6502::EffectiveAddress does
+    AluReg(OpAdd, lowReg, indexReg);
+    ShiftRegImm(ExtShr, lowReg, 8);
+    OpMem(0x01, 1, false, lowReg, CPU(&_cpu._cycles)); // add [cycles], reg
+}
+
+void JIT::EmitRead(const Address& address)
+{
+    // Non-null read pages always point to the RAM, so the page table is only consulted to tell I/O apart.
+    // The result is in eax
+    if (address.zeroPage)
+    {
+        MovzxByte(RAX, address.dynamic ? RAM(&_ram._ram[0], R14) : RAM(&_ram._ram[address.value]));
+        return;
+    }
+
+    if (!address.dynamic)
+    {
+        unsigned char page = (unsigned char)(address.value >> 8);
+        if (page < 0xd0 || page >= 0xe0)
+        {
+            MovzxByte(RAX, RAM(&_ram._ram[address.value]));
+            return;
+        }
+        CmpMem64Zero(RAM(&_ram._readPages[page]));
+    }
+    else
+    {
+        MovReg(RCX, R14);
+        ShiftRegImm(ExtShr, RCX, 8);
+        CmpMem64Zero(RAM(&_ram._readPages[0], RCX, 8));
+    }
+
+    int done = NewLabel();
+    Jcc(CondE, AddSlowPath(SlowRead, done, address));
+    MovzxByte(RAX, address.dynamic ? RAM(&_ram._ram[0], R14) : RAM(&_ram._ram[address.value]));
+    Bind(done);
+}
+
+void JIT::EmitWrite(const Address& address)
+{
+    // The value is in edx. Stores go directly to RAM unless they hit I/O, watched bytes or the $01 banking register
+    int done = NewLabel();
+    int slow = AddSlowPath(SlowWrite, done, address);
+
+    if (!address.dynamic)
+    {
+        unsigned char page = (unsigned char)(address.value >> 8);
+        if (address.value <= 0x01)
+        {
+            Jmp(slow);
+            Bind(done);
+            return;
+        }
+        AluMem8(ExtCmp, RAM(&_ram._watchedBytes[address.value]), 0);
+        Jcc(CondNE, slow);
+        if (page >= 0xd0 && page < 0xe0)
+        {
+            CmpMem64Zero(RAM(&_ram._readPages[page]));
+            Jcc(CondE, slow);
+        }
+        Store8(RAM(&_ram._ram[address.value]), RDX);
+    }
+    else
+    {
+        AluRegImm(ExtCmp, R14, 0x01);
+        Jcc(CondBE, slow);
+        AluMem8(ExtCmp, RAM(&_ram._watchedBytes[0], R14), 0);
+        Jcc(CondNE, slow);
+        if (!address.zeroPage)
+        {
+            MovReg(RCX, R14);
+            ShiftRegImm(ExtShr, RCX, 8);
+            CmpMem64Zero(RAM(&_ram._readPages[0], RCX, 8));
+            Jcc(CondE, slow);
+        }
+        Store8(RAM(&_ram._ram[0], R14), RDX);
+    }
+    Bind(done);
+}
+
+void JIT::EmitPush()
+{
+    // The value is in edx. Only watched bytes on the stack page need the slow path
+    Mem sp = CPU(&_cpu._sp);
+    MovzxByte(RCX, sp);
+    Address address = { false, false, 0 };
+    int done = NewLabel();
+    AluMem8(ExtCmp, RAM(&_ram._watchedBytes[0x100], RCX), 0);
+    Jcc(CondNE, AddSlowPath(SlowPush, done, address));
+    Store8(RAM(&_ram._ram[0x100], RCX), RDX);
+    Bind(done);
+    AluMem8(ExtSub, sp, 1);
+}
+
+void JIT::EmitPop()
+{
+    // The result is in eax
+    Mem sp = CPU(&_cpu._sp);
+    AluMem8(ExtAdd, sp, 1);
+    MovzxByte(RCX, sp);
+    MovzxByte(RAX, RAM(&_ram._ram[0x100], RCX));
+}
+
+void JIT::EmitFallback(unsigned char opcode, unsigned short pc, unsigned short operand)
+{
+    StoreImm16(CPU(&_cpu._pc), pc);
+    MovReg64(RDI, RBX);
+    MovRegImm(RSI, opcode);
+    MovRegImm(RDX, operand);
+    Call((unsigned long long)&MOS6502::JITStep);
+}
+
+void JIT::EmitExitCheck(unsigned short nextPC, bool codeWrites)
+{
+    // Same conditions as interpreted blocks in MOS6502::RunUntil. Writes to code may have changed the rest of the block
+    Address address = { false, false, nextPC };
+    int exit = AddSlowPath(SlowExit, _exitLabel, address);
+    Load(RAX, CPU(&_cpu._cycles));
+    CmpRegMem(RAX, CPU(&_cpu._targetCycles));
+    Jcc(CondGE, exit);
+    if (codeWrites)
+    {
+        Load(RAX, RAM(&_ram._codeWrites));
+        CmpRegMem(RAX, CPU(&_cpu._blockCodeWrites));
+        Jcc(CondNE, exit);
+    }
+}
+
+void JIT::EmitDispatch(bool chain)
+{
+    // The next PC is stored. Continue in its compiled block if MOS6502::RunUntil would run it next
+    Bind(_dispatchLabel);
+    if (!chain)
+        return;
+
+    Load(RAX, CPU(&_cpu._cycles));
+    CmpRegMem(RAX, CPU(&_cpu._targetCycles));
+    Jcc(CondGE, _exitLabel);
+    Load(RAX, RAM(&_ram._codeWrites));
+    CmpRegMem(RAX, CPU(&_cpu._blockCodeWrites));
+    Jcc(CondNE, _exitLabel);
+    AluMem8(ExtCmp, CPU(&_cpu._reset), 0);
+    Jcc(CondNE, _exitLabel);
+    AluMem8(ExtCmp, CPU(&_cpu._nmi), 0);
+    Jcc(CondNE, _exitLabel);
+    AluMem8(ExtCmp, CPU(&_cpu._jam), 0);
+    Jcc(CondNE, _exitLabel);
+    int noIRQ = NewLabel();
+    AluMem8(ExtCmp, CPU(&_cpu._irq), 0);
+    Jcc(CondE, noIRQ);
+    TestMem8(CPU(&_cpu._flags), FLAG_INTERRUPT);
+    Jcc(CondE, _exitLabel);
+    Bind(noIRQ);
+
+    // Same validity checks as MOS6502::GetBlock. Idle loops are left to RunUntil
+    MovzxWord(RCX, CPU(&_cpu._pc));
+    Load64(RAX, At(RBX, CPU(&_cpu._blocks[0]).disp, RCX, 8));
+    TestReg64(RAX);
+    Jcc(CondE, _exitLabel);
+    Load64(RDX, At(RAX, offsetof(MOS6502::CodeBlock, compiled)));
+    TestReg64(RDX);
+    Jcc(CondE, _exitLabel);
+    AluMem8(ExtCmp, At(RAX, offsetof(MOS6502::CodeBlock, idleLoop)), 0);
+    Jcc(CondNE, _exitLabel);
+    MovzxByte(RCX, At(RAX, offsetof(MOS6502::CodeBlock, startAddress) + 1));
+    Load(RCX, RAM(&_ram._pageGenerations[0], RCX, 4));
+    CmpRegMem(RCX, At(RAX, offsetof(MOS6502::CodeBlock, pageGenerations)));
+    Jcc(CondNE, _exitLabel);
+    MovzxByte(RCX, At(RAX, offsetof(MOS6502::CodeBlock, lastAddress) + 1));
+    Load(RCX, RAM(&_ram._pageGenerations[0], RCX, 4));
+    CmpRegMem(RCX, At(RAX, offsetof(MOS6502::CodeBlock, pageGenerations) + sizeof(unsigned)));
+    Jcc(CondNE, _exitLabel);
+
+    AluMem32(ExtAdd, CPU(&_cpu._blockHits), 1);
+    OpReg(0x83, 1, true, ExtAdd, RDX);
+    Emit(JIT_PROLOGUE_SIZE);
+    JmpReg(RDX);
+}
+
+void JIT::EmitSlowPaths()
+{
+    for (unsigned i = 0; i < _slowPaths.size(); ++i)
+    {
+        const SlowPath& slow = _slowPaths[i];
+        Bind(slow.label);
+
+        switch (slow.kind)
+        {
+            case SlowRead:
+            case SlowWrite:
+                MovReg64(RDI, R15);
+                if (slow.address.dynamic)
+                    MovReg(RSI, R14);
+                else
+                    MovRegImm(RSI, slow.address.value);
+                Call(slow.kind == SlowRead ? (unsigned long long)&ReadMemory : (unsigned long long)&WriteMemory);
+                break;
+
+            case SlowPush:
+                MovReg64(RDI, R15);
+                MovReg(RSI, RCX);
+                AluRegImm(ExtOr, RSI, 0x100);
+                Call((unsigned long long)&WriteStack);
+                break;
+
+            case SlowFallback:
+                EmitFallback(slow.opcode, slow.pc, slow.operand);
+                break;
+
+            case SlowExit:
+                StoreImm16(CPU(&_cpu._pc), slow.address.value);
+                break;
+        }
+
+        Jmp(slow.returnLabel);
+    }
+}
+
+int JIT::AddSlowPath(int kind, int returnLabel, const Address& address)
+{
+    SlowPath slow;
+    slow.label = NewLabel();
+    slow.returnLabel = returnLabel;
+    slow.kind = kind;
+    slow.address = address;
+    slow.pc = 0;
+    slow.opcode = 0;
+    slow.operand = 0;
+    _slowPaths.push_back(slow);
+    return slow.label;
+}
+
+JIT::Mem JIT::CPU(const void* field) const
+{
+    return At(RBX, (int)((const unsigned char*)field - (const unsigned char*)&_cpu));
+}
+
+JIT::Mem JIT::RAM(const void* field, int index, int scale) const
+{
+    return At(R15, (int)((const unsigned char*)field - (const unsigned char*)&_ram), index, scale);
+}
+
+JIT::Mem JIT::At(int base, int disp, int index, int scale) const
+{
+    Mem mem = { base, index, scale, disp };
+    return mem;
+}
+
+int JIT::NewLabel()
+{
+    _labels.push_back(-1);
+    return (int)_labels.size() - 1;
+}
+
+void JIT::Bind(int label)
+{
+    _labels[label] = (int)_code.size();
+}
+
+void JIT::Jcc(int condition, int label)
+{
+    Emit(0x0f);
+    Emit((unsigned char)(0x80 + condition));
+    Fixup fixup = { (unsigned)_code.size(), label };
+    _fixups.push_back(fixup);
+    Emit32(0);
+}
+
+void JIT::Jmp(int label)
+{
+    Emit(0xe9);
+    Fixup fixup = { (unsigned)_code.size(), label };
+    _fixups.push_back(fixup);
+    Emit32(0);
+}
+
+void JIT::Emit(unsigned char byte)
+{
+    _code.push_back(byte);
+}
+
+void JIT::Emit16(unsigned value)
+{
+    Emit((unsigned char)value);
+    Emit((unsigned char)(value >> 8));
+}
+
+void JIT::Emit32(unsigned value)
+{
+    for (int i = 0; i < 4; ++i)
+        Emit((unsigned char)(value >> (i * 8)));
+}
+
+void JIT::Emit64(unsigned long long value)
+{
+    for (int i = 0; i < 8; ++i)
+        Emit((unsigned char)(value >> (i * 8)));
+}
+
+void JIT::EmitOpcode(unsigned opcode, int opcodeBytes)
+{
+    if (opcodeBytes == 2)
+        Emit((unsigned char)(opcode >> 8));
+    Emit((unsigned char)opcode);
+}
+
+void JIT::OpMem(unsigned opcode, int opcodeBytes, bool wide, int reg, const Mem& mem, bool byteReg)
+{
+    // Always encoded with a 32-bit displacement
+    bool hasIndex = mem.index >= 0;
+    int rex = (wide ? 0x8 : 0) | ((reg & 8) ? 0x4 : 0) | ((hasIndex && (mem.index & 8)) ? 0x2 : 0) |
+        ((mem.base & 8) ? 0x1 : 0);
+    if (rex || (byteReg && reg >= RSP && reg <= RDI))
+        Emit((unsigned char)(0x40 | rex));
+    EmitOpcode(opcode, opcodeBytes);
+
+    if (!hasIndex && (mem.base & 7) != RSP)
+        Emit((unsigned char)(0x80 | ((reg & 7) << 3) | (mem.base & 7)));
+    else
+    {
+        int scaleBits = mem.scale == 8 ? 3 : (mem.scale == 4 ? 2 : (mem.scale == 2 ? 1 : 0));
+        Emit((unsigned char)(0x80 | ((reg & 7) << 3) | RSP));
+        Emit((unsigned char)((scaleBits << 6) | ((hasIndex ? mem.index : RSP) & 7) << 3 | (mem.base & 7)));
+    }
+    Emit32((unsigned)mem.disp);
+}
+
+void JIT::OpReg(unsigned opcode, int opcodeBytes, bool wide, int reg, int rm, bool byteReg)
+{
+    int rex = (wide ? 0x8 : 0) | ((reg & 8) ? 0x4 : 0) | ((rm & 8) ? 0x1 : 0);
+    if (rex || (byteReg && ((reg >= RSP && reg <= RDI) || (rm >= RSP && rm <= RDI))))
+        Emit((unsigned char)(0x40 | rex));
+    EmitOpcode(opcode, opcodeBytes);
+    Emit((unsigned char)(0xc0 | ((reg & 7) << 3) | (rm & 7)));
+}
+
+void JIT::AluMem32(int ext, const Mem& mem, int imm)
+{
+    if (imm >= -128 && imm <= 127)
+    {
+        OpMem(0x83, 1, false, ext, mem);
+        Emit((unsigned char)imm);
+    }
+    else
+    {
+        OpMem(0x81, 1, false, ext, mem);
+        Emit32((unsigned)imm);
+    }
+}
+
+void JIT::AluRegImm(int ext, int reg, int imm)
+{
+    if (imm >= -128 && imm <= 127)
+    {
+        OpReg(0x83, 1, false, ext, reg);
+        Emit((unsigned char)imm);
+    }
+    else
+    {
+        OpReg(0x81, 1, false, ext, reg);
+        Emit32((unsigned)imm);
+    }
+}
+
+void JIT::MovRegImm(int reg, unsigned imm)
+{
+    if (reg & 8)
+        Emit(0x41);
+    Emit((unsigned char)(0xb8 + (reg & 7)));
+    Emit32(imm);
+}
+
+void JIT::MovRegImm64(int reg, unsigned long long imm)
+{
+    Emit((unsigned char)(0x48 | ((reg & 8) ? 0x1 : 0)));
+    Emit((unsigned char)(0xb8 + (reg & 7)));
+    Emit64(imm);
+}
+
+void JIT::Push(int reg)
+{
+    if (reg & 8)
+        Emit(0x41);
+    Emit((unsigned char)(0x50 + (reg & 7)));
+}
+
+void JIT::Pop(int reg)
+{
+    if (reg & 8)
+        Emit(0x41);
+    Emit((unsigned char)(0x58 + (reg & 7)));
+}
+
+void JIT::Call(unsigned long long function)
+{
+    // The stack is 16-byte aligned after the prologue's three pushes
+    MovRegImm64(RAX, function);
+    Emit(0xff);
+    Emit(0xd0); // call rax
+}
+
+#endif
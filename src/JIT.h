@@ -0,0 +1,177 @@
+// MIT License
+// 
+// Copyright (c) 2018-2026 Lasse Oorni
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+// The JIT generates x86-64 code for the System V calling convention, so it is only available in native x86-64 Linux
+// builds
+#if defined(__x86_64__) && defined(__linux__) && !defined(__EMSCRIPTEN__)
+#define JIT_SUPPORTED 1
+#endif
+
+#ifdef JIT_SUPPORTED
+
+#include <vector>
+#include "MOS6502.h"
+
+class RAM64K;
+
+const unsigned JIT_ARENA_SIZE = 4 * 1024 * 1024;
+
+// Translates cached 6502 blocks to x86-64 code. Register, flag and stack operations are generated inline and RAM is
+// accessed through the RAM64K page tables. I/O, writes to code and rare opcodes (decimal mode arithmetic, interrupt
+// related opcodes, indirect jumps and illegal opcodes) call out to the interpreter. A compiled block stops on the same
+// instruction boundary as the interpreter would, and at its end jumps directly to the next compiled block while no
+// interrupt is pending and the cycle target has not been reached
+class JIT
+{
+public:
+    typedef void (*BlockFunction)(MOS6502* cpu);
+
+    JIT(MOS6502& cpu, RAM64K& ram);
+    ~JIT();
+
+    BlockFunction Compile(const MOS6502::CodeBlock& block);
+    void Flush();
+    bool IsAvailable() const { return _arena != nullptr; }
+    unsigned CompiledBlocks() const { return _compiledBlocks; }
+    unsigned Flushes() const { return _flushes; }
+
+private:
+    // x86-64 general purpose registers in encoding order
+    enum Reg
+    {
+        RAX = 0, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15
+    };
+
+    // Memory operand [base + index * scale + disp]. Negative index means none
+    struct Mem
+    {
+        int base;
+        int index;
+        int scale;
+        int disp;
+    };
+
+    // Effective address of an opcode, either known at compile time or computed into r14d
+    struct Address
+    {
+        bool dynamic;
+        bool zeroPage;
+        unsigned short value;
+    };
+
+    struct Fixup
+    {
+        unsigned offset;
+        int label;
+    };
+
+    // Out-of-line code for the uncommon case, emitted after the block
+    struct SlowPath
+    {
+        int label;
+        int returnLabel;
+        int kind;
+        Address address;
+        unsigned short pc;
+        unsigned char opcode;
+        unsigned short operand;
+    };
+
+    void CompileOpcode(const MOS6502::DecodedOpcode& decoded, unsigned short pc, bool last);
+    void CompileBranch(int operation, const MOS6502::DecodedOpcode& decoded, unsigned short nextPC);
+    Address EmitEffectiveAddress(const MOS6502::OpcodeInfo& info, unsigned short operand, unsigned short pc);
+    void EmitPageCrossCycle(int indexReg, int lowReg);
+    void EmitRead(const Address& address);
+    void EmitWrite(const Address& address);
+    void EmitPush();
+    void EmitPop();
+    void EmitFallback(unsigned char opcode, unsigned short pc, unsigned short operand);
+    void EmitExitCheck(unsigned short nextPC, bool codeWrites);
+    void EmitDispatch(bool chain);
+    void EmitSlowPaths();
+    int AddSlowPath(int kind, int returnLabel, const Address& address);
+
+    Mem CPU(const void* field) const;
+    Mem RAM(const void* field, int index = -1, int scale = 1) const;
+    Mem At(int base, int disp, int index = -1, int scale = 1) const;
+
+    int NewLabel();
+    void Bind(int label);
+    void Jcc(int condition, int label);
+    void Jmp(int label);
+
+    void Emit(unsigned char byte);
+    void Emit16(unsigned value);
+    void Emit32(unsigned value);
+    void Emit64(unsigned long long value);
+    void EmitOpcode(unsigned opcode, int opcodeBytes);
+    void OpMem(unsigned opcode, int opcodeBytes, bool wide, int reg, const Mem& mem, bool byteReg = false);
+    void OpReg(unsigned opcode, int opcodeBytes, bool wide, int reg, int rm, bool byteReg = false);
+
+    void MovzxByte(int reg, const Mem& mem) { OpMem(0x0fb6, 2, false, reg, mem); }
+    void MovzxWord(int reg, const Mem& mem) { OpMem(0x0fb7, 2, false, reg, mem); }
+    void MovzxByteReg(int reg, int rm) { OpReg(0x0fb6, 2, false, reg, rm, true); }
+    void MovzxWordReg(int reg, int rm) { OpReg(0x0fb7, 2, false, reg, rm); }
+    void Load(int reg, const Mem& mem) { OpMem(0x8b, 1, false, reg, mem); }
+    void Load64(int reg, const Mem& mem) { OpMem(0x8b, 1, true, reg, mem); }
+    void Store8(const Mem& mem, int reg) { OpMem(0x88, 1, false, reg, mem, true); }
+    void Store16(const Mem& mem, int reg) { Emit(0x66); OpMem(0x89, 1, false, reg, mem); }
+    void StoreImm16(const Mem& mem, unsigned short imm) { Emit(0x66); OpMem(0xc7, 1, false, 0, mem); Emit16(imm); }
+    void AluMem8(int ext, const Mem& mem, unsigned char imm) { OpMem(0x80, 1, false, ext, mem); Emit(imm); }
+    void AluMem32(int ext, const Mem& mem, int imm);
+    void CmpMem64Zero(const Mem& mem) { OpMem(0x83, 1, true, 7, mem); Emit(0); }
+    void TestMem8(const Mem& mem, unsigned char imm) { OpMem(0xf6, 1, false, 0, mem); Emit(imm); }
+    void TestMem16(const Mem& mem, unsigned short imm) { Emit(0x66); OpMem(0xf7, 1, false, 0, mem); Emit16(imm); }
+    void CmpRegMem(int reg, const Mem& mem) { OpMem(0x3b, 1, false, reg, mem); }
+    void AluReg(unsigned opcode, int dest, int src) { OpReg(opcode, 1, false, src, dest); }
+    void AluRegImm(int ext, int reg, int imm);
+    void TestRegImm(int reg, unsigned imm) { OpReg(0xf7, 1, false, 0, reg); Emit32(imm); }
+    void TestReg64(int reg) { OpReg(0x85, 1, true, reg, reg); }
+    void ShiftRegImm(int ext, int reg, unsigned char imm) { OpReg(0xc1, 1, false, ext, reg); Emit(imm); }
+    void Setcc(int condition, int reg) { OpReg(0x0f90 + condition, 2, false, 0, reg, true); }
+    void MovRegImm(int reg, unsigned imm);
+    void MovRegImm64(int reg, unsigned long long imm);
+    void MovReg(int dest, int src) { AluReg(0x89, dest, src); }
+    void MovReg64(int dest, int src) { OpReg(0x89, 1, true, src, dest); }
+    void Push(int reg);
+    void Pop(int reg);
+    void Call(unsigned long long function);
+    void JmpReg(int reg) { OpReg(0xff, 1, false, 4, reg); }
+
+    MOS6502& _cpu;
+    RAM64K& _ram;
+    unsigned char* _arena;
+    unsigned char* _writableArena;
+    unsigned _used;
+    unsigned _compiledBlocks;
+    unsigned _flushes;
+    std::vector<unsigned char> _code;
+    std::vector<int> _labels;
+    std::vector<Fixup> _fixups;
+    std::vector<SlowPath> _slowPaths;
+    int _dispatchLabel;
+    int _exitLabel;
+};
+
+#endif
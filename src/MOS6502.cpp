@@ -25,6 +25,7 @@
 #include "MOS6502.h"
 #include "RAM64K.h"
 #include "Emulator.h"
+#include "JIT.h"
 
 MOS6502::MOS6502(RAM64K& ram, Emulator& emulator) :
     _ram(ram),
@@ -34,12 +35,31 @@ MOS6502::MOS6502(RAM64K& ram, Emulator& emulator) :
     _irq(false),
     _reset(false),
     _jam(false),
-    _cycles(0)
+    _cycles(0),
+    _targetCycles(0),
+    _blockHits(0),
+    _blockMisses(0),
+    _blockInvalidations(0),
+    _blockCodeWrites(0),
+    _idleCyclesSkipped(0),
+    _jit(nullptr)
 {
+    for (unsigned i = 0; i < 65536; ++i)
+        _blocks[i] = nullptr;
+    for (unsigned i = 0; i < 256; ++i)
+        _operations[i] = (unsigned char)Classify(_opcodeTable[i]);
+
     SetStatus(0);
     Reset();
 }
 
+MOS6502::~MOS6502()
+{
+    SetJITEnabled(false);
+    for (unsigned i = 0; i < 65536; ++i)
+        delete _blocks[i];
+}
+
 void MOS6502::CountCycle(int cycles)
 {
     _cycles += cycles;
@@ -58,9 +78,21 @@ unsigned short MOS6502::Combine(unsigned char a, unsigned char b)
     return value;
 }
 
+// Zero page and stack are always RAM, so they bypass the memory map.
+// Writes still go through WriteRAM so that $01 banking and code invalidation work
+unsigned char MOS6502::ReadZeroPage(unsigned char address)
+{
+    return _ram.ReadRAM(address);
+}
+
+unsigned short MOS6502::ReadZeroPage16(unsigned char address)
+{
+    return Combine(ReadZeroPage(address), _ram.ReadRAM((unsigned short)(address + 1)));
+}
+
 void MOS6502::Push(unsigned char data)
 {
-    _ram.Write((unsigned short)(_sp | 0x0100), data);
+    _ram.WriteRAM((unsigned short)(_sp | 0x0100), data);
     _sp--;
 }
 void MOS6502::Push16(unsigned short data)
@@ -72,7 +104,7 @@ void MOS6502::Push16(unsigned short data)
 unsigned char MOS6502::Pop()
 {
     _sp++;
-    return _ram.Read((unsigned short)(_sp | 0x0100));
+    return _ram.ReadRAM((unsigned short)(_sp | 0x0100));
 }
 unsigned short MOS6502::Pop16()
 {
@@ -126,11 +158,11 @@ unsigned short MOS6502::AbsoluteY(unsigned short address, bool checkPage)
 }
 unsigned short MOS6502::IndirectX(unsigned char address)
 {
-    return _ram.Read16((unsigned short)((address + _x) & 0xFF));
+    return ReadZeroPage16((unsigned char)(address + _x));
 }
 unsigned short MOS6502::IndirectY(unsigned char address, bool checkPage)
 {
-    unsigned short value = _ram.Read16(address);
+    unsigned short value = ReadZeroPage16(address);
     unsigned short translatedAddress = (unsigned short)(value + _y);
     if (checkPage)
         CheckPageBoundaries(value, translatedAddress);
@@ -139,41 +171,40 @@ unsigned short MOS6502::IndirectY(unsigned char address, bool checkPage)
 
 void MOS6502::SetZN(unsigned char value)
 {
-    _zero = value == 0;
-    _negative = (value & 0x80) != 0;
+    _znResult = value;
 }
 
 void MOS6502::ADC(unsigned char value)
 {
-    if (_decimal)
+    if (Decimal())
     {
         // Low nybble
-        int low = (_a & 0xF) + (value & 0xF) + (_carry ? 0x1 : 0);
+        int low = (_a & 0xF) + (value & 0xF) + (Carry() ? 0x1 : 0);
         bool halfCarry = (low > 0x9);
 
         // High nybble
         int high = (_a & 0xF0) + (value & 0xF0) + (halfCarry ? 0x10 : 0);
-        _carry = (high > 0x9F);
+        SetFlag(FLAG_CARRY, high > 0x9F);
 
         // Set flags on the binary result
         unsigned char binary = (unsigned char)((low & 0xF) + (high & 0xF0));
         SetZN(binary);
-        _overflow = ((_a ^ binary) & (value ^ binary) & 0x80) != 0;
+        SetFlag(FLAG_OVERFLOW, ((_a ^ binary) & (value ^ binary) & 0x80) != 0);
         //_overflow = ((_a ^ value) & 0x80) == 0 && binary > 127 && binary < 0x180;
 
         // Decimal adjust
         if (halfCarry)
             low += 0x6;
-        if (_carry)
+        if (Carry())
             high += 0x60;
 
         _a = (unsigned char)((low & 0xF) + (high & 0xF0));
     }
     else
     {
-        int result = _a + value + (_carry ? 1 : 0);
-        _overflow = ((_a ^ result) & (value ^ result) & 0x80) != 0;
-        _carry = result > 0xFF;
+        int result = _a + value + (Carry() ? 1 : 0);
+        SetFlag(FLAG_OVERFLOW, ((_a ^ result) & (value ^ result) & 0x80) != 0);
+        SetFlag(FLAG_CARRY, result > 0xFF);
         _a = (unsigned char)result;
         SetZN(_a);
     }
@@ -195,7 +226,7 @@ void MOS6502::AND(unsigned short address)
 
 unsigned char MOS6502::ASL(unsigned char value)
 {
-    _carry = (value & 0x80) != 0;
+    SetFlag(FLAG_CARRY, (value & 0x80) != 0);
     value <<= 1;
     SetZN(value);
     return value;
@@ -206,9 +237,8 @@ void MOS6502::ASL(unsigned short address)
     _ram.Write(address, ASL(value));
 }
 
-void MOS6502::Bxx(unsigned char value)
+void MOS6502::Bxx(unsigned short address)
 {
-    unsigned short address = (unsigned short)(_pc + (signed char)value);
     CheckPageBoundaries(_pc, address);
     _pc = address;
     CountCycle();
@@ -217,21 +247,28 @@ void MOS6502::Bxx(unsigned char value)
 void MOS6502::BIT(unsigned short address)
 {
     unsigned char value = _ram.Read(address);
-    _overflow = (value & 0x40) != 0;
-    _negative = (value & 0x80) != 0;
-    value &= _a;
-    _zero = value == 0;
+    SetFlag(FLAG_OVERFLOW, (value & 0x40) != 0);
+    // N comes from bit 7 of the operand, Z from the AND result
+    _znResult = (unsigned short)((value & _a) | ((value & 0x80) << 1));
 }
 
 void MOS6502::Cxx(unsigned char value, unsigned char reg)
 {
-    _carry = (reg >= value);
+    SetFlag(FLAG_CARRY, reg >= value);
     value = (unsigned char)(reg - value);
     SetZN(value);
 }
-void MOS6502::Cxx(unsigned short address, unsigned char reg)
+void MOS6502::CMP(unsigned short address)
+{
+    Cxx(_ram.Read(address), _a);
+}
+void MOS6502::CPX(unsigned short address)
 {
-    Cxx(_ram.Read(address), reg);
+    Cxx(_ram.Read(address), _x);
+}
+void MOS6502::CPY(unsigned short address)
+{
+    Cxx(_ram.Read(address), _y);
 }
 
 unsigned char MOS6502::Dxx(unsigned char value)
@@ -299,7 +336,7 @@ void MOS6502::LDY(unsigned short address)
 
 unsigned char MOS6502::LSR(unsigned char value)
 {
-    _carry = (value & 0x1) != 0;
+    SetFlag(FLAG_CARRY, (value & 0x1) != 0);
     value >>= 1;
     SetZN(value);
     return value;
@@ -322,8 +359,8 @@ void MOS6502::ORA(unsigned short address)
 
 unsigned char MOS6502::ROL(unsigned char value)
 {
-    bool oldCarry = _carry;
-    _carry = (value & 0x80) != 0;
+    bool oldCarry = Carry();
+    SetFlag(FLAG_CARRY, (value & 0x80) != 0);
     value <<= 1;
     if (oldCarry) value |= 0x1;
     SetZN(value);
@@ -337,8 +374,8 @@ void MOS6502::ROL(unsigned short address)
 
 unsigned char MOS6502::ROR(unsigned char value)
 {
-    bool oldCarry = _carry;
-    _carry = (value & 0x1) != 0;
+    bool oldCarry = Carry();
+    SetFlag(FLAG_CARRY, (value & 0x1) != 0);
     value >>= 1;
     if (oldCarry) value |= 0x80;
     SetZN(value);
@@ -352,35 +389,35 @@ void MOS6502::ROR(unsigned short address)
 
 void MOS6502::SBC(unsigned char value)
 {
-    if (_decimal)
+    if (Decimal())
     {
         // Low nybble
-        int low = 0xF + (_a & 0xF) - (value & 0xF) + (_carry ? 0x1 : 0);
+        int low = 0xF + (_a & 0xF) - (value & 0xF) + (Carry() ? 0x1 : 0);
         bool halfCarry = (low > 0xF);
 
         // High nybble
         int high = 0xF0 + (_a & 0xF0) - (value & 0xF0) + (halfCarry ? 0x10 : 0);
-        _carry = (high > 0xFF);
+        SetFlag(FLAG_CARRY, high > 0xFF);
 
         // Set flags on the binary result
         unsigned char binary = (unsigned char)((low & 0xF) + (high & 0xF0));
         SetZN(binary);
-        _overflow = ((_a ^ binary) & (~value ^ binary) & 0x80) != 0;
+        SetFlag(FLAG_OVERFLOW, ((_a ^ binary) & (~value ^ binary) & 0x80) != 0);
         //_overflow = ((_a ^ value) & 0x80) != 0 && result >= 0x80 && result < 0x180;
 
         // Decimal adjust
         if (!halfCarry)
             low -= 0x6;
-        if (!_carry)
+        if (!Carry())
             high -= 0x60;
 
         _a = (unsigned char)((low & 0xF) + (high & 0xF0));
     }
     else
     {
-        int result = 0xFF + _a - value + (_carry ? 1 : 0);
-        _overflow = ((_a ^ result) & (~value ^ result) & 0x80) != 0;
-        _carry = result > 0xFF;
+        int result = 0xFF + _a - value + (Carry() ? 1 : 0);
+        SetFlag(FLAG_OVERFLOW, ((_a ^ result) & (~value ^ result) & 0x80) != 0);
+        SetFlag(FLAG_CARRY, result > 0xFF);
         _a = (unsigned char)result;
         SetZN(_a);
     }
@@ -409,15 +446,590 @@ void MOS6502::Reset()
 }
 
 /// <summary>
-/// Execute the next opcode.
+/// Execute the next opcode, or take a pending reset / interrupt.
 /// </summary>
 void MOS6502::Process()
+{
+    if (_reset || _jam || _nmi || _irq)
+    {
+        if (HandleInterrupts())
+            return;
+    }
+
+    ExecuteOpcode();
+}
+
+/// <summary>
+/// Copy the registers and the cycle count to a local working set.
+/// </summary>
+inline void MOS6502::LoadRegisters(Registers& regs) const
+{
+    regs.pc = _pc;
+    regs.a = _a;
+    regs.x = _x;
+    regs.y = _y;
+    regs.sp = _sp;
+    regs.flags = _flags;
+    regs.znResult = _znResult;
+    regs.cycles = _cycles;
+}
+
+/// <summary>
+/// Copy a local working set back to the registers and the cycle count.
+/// </summary>
+inline void MOS6502::StoreRegisters(const Registers& regs)
+{
+    _pc = regs.pc;
+    _a = regs.a;
+    _x = regs.x;
+    _y = regs.y;
+    _sp = regs.sp;
+    _flags = regs.flags;
+    _znResult = regs.znResult;
+    _cycles = regs.cycles;
+}
+
+/// <summary>
+/// Read memory while running on local registers. I/O hooks see the cycle count passed in.
+/// </summary>
+inline unsigned char MOS6502::Load(unsigned short address, int cycles)
+{
+    const unsigned char* page = _ram.ReadPage((unsigned char)(address >> 8));
+    if (page)
+        return page[address & 0xff];
+
+    _cycles = cycles;
+    return _ram.ReadIO(address);
+}
+
+/// <summary>
+/// Write memory while running on local registers. I/O hooks see the cycle count passed in.
+/// </summary>
+inline void MOS6502::Store(unsigned short address, unsigned char value, int cycles)
+{
+    unsigned char* page = _ram.WritePage((unsigned char)(address >> 8));
+    if (page)
+    {
+        page[address & 0xff] = value;
+        return;
+    }
+
+    _cycles = cycles;
+    _ram.Write(address, value);
+}
+
+/// <summary>
+/// Take a branch while running on local registers.
+/// </summary>
+inline void MOS6502::Branch(Registers& regs, unsigned short address)
+{
+    if ((regs.pc & 0xFF00) != (address & 0xFF00))
+        ++regs.cycles;
+    regs.pc = address;
+    ++regs.cycles;
+}
+
+/// <summary>
+/// Execute opcodes until the cycle count reaches the target or the CPU jams. The target can be lowered during the run
+/// with LimitRun.
+/// Interrupts are only checked at instruction boundaries when one is pending.
+/// Code is executed from the block cache when possible, and idle loops are fast-forwarded to the target.
+/// Cached blocks run on a local copy of the registers. Common opcodes are executed inline, others call their handler
+/// with the members brought up to date.
+/// </summary>
+void MOS6502::RunUntil(int targetCycles)
+{
+    _targetCycles = targetCycles;
+
+    Registers regs;
+    LoadRegisters(regs);
+
+    while (regs.cycles < _targetCycles && !_jam)
+    {
+        if (_reset || _nmi || _irq)
+        {
+            StoreRegisters(regs);
+            bool taken = HandleInterrupts();
+            LoadRegisters(regs);
+            if (taken)
+                continue;
+        }
+
+        CodeBlock* block = GetBlock(regs.pc);
+        if (!block)
+        {
+            StoreRegisters(regs);
+            ExecuteOpcode();
+            LoadRegisters(regs);
+            continue;
+        }
+
+        int startCycles = regs.cycles;
+        unsigned long long idleState = block->idleLoop ? IdleLoopState(regs) : 0;
+
+        if (block->compiled)
+        {
+            StoreRegisters(regs);
+            _blockCodeWrites = _ram.CodeWrites();
+            block->compiled(this);
+            LoadRegisters(regs);
+        }
+        else
+        {
+            // Execute the block until its end, the cycle target, or a write to code
+            unsigned codeWrites = _ram.CodeWrites();
+
+            for (int i = 0; i < block->numOpcodes; ++i)
+            {
+                const DecodedOpcode& decoded = block->opcodes[i];
+                const OpcodeInfo& info = *decoded.info;
+                unsigned short operand = decoded.operand;
+                unsigned short address = 0;
+                unsigned char value;
+                int result;
+
+                // As in ExecuteOpcode, page crossing penalties are counted before the access and base cycles after it
+                switch (info.mode)
+                {
+                    case ModeImmediate:
+                        address = (unsigned short)(regs.pc + 1);
+                        break;
+
+                    case ModeZeroPage:
+                    case ModeAbsolute:
+                        address = operand;
+                        break;
+
+                    case ModeZeroPageX:
+                        address = (unsigned short)((operand + regs.x) & 0xFF);
+                        break;
+
+                    case ModeZeroPageY:
+                        address = (unsigned short)((operand + regs.y) & 0xFF);
+                        break;
+
+                    case ModeAbsoluteX:
+                        address = (unsigned short)(operand + regs.x);
+                        if (info.pageCrossPenalty && (address & 0xFF00) != (operand & 0xFF00))
+                            ++regs.cycles;
+                        break;
+
+                    case ModeAbsoluteY:
+                        address = (unsigned short)(operand + regs.y);
+                        if (info.pageCrossPenalty && (address & 0xFF00) != (operand & 0xFF00))
+                            ++regs.cycles;
+                        break;
+
+                    case ModeIndirect:
+                        _cycles = regs.cycles;
+                        address = EffectiveAddress(info, operand);
+                        break;
+
+                    case ModeIndirectX:
+                        address = ReadZeroPage16((unsigned char)(operand + regs.x));
+                        break;
+
+                    case ModeIndirectY:
+                        operand = ReadZeroPage16((unsigned char)operand);
+                        address = (unsigned short)(operand + regs.y);
+                        if (info.pageCrossPenalty && (address & 0xFF00) != (operand & 0xFF00))
+                            ++regs.cycles;
+                        break;
+
+                    case ModeRelative:
+                        address = (unsigned short)(regs.pc + 2 + (signed char)operand);
+                        break;
+
+                    default:
+                        break;
+                }
+
+                regs.pc += info.length;
+
+                switch (decoded.operation)
+                {
+                    case OperationLDA:
+                        regs.a = Load(address, regs.cycles);
+                        regs.znResult = regs.a;
+                        break;
+
+                    case OperationLDX:
+                        regs.x = Load(address, regs.cycles);
+                        regs.znResult = regs.x;
+                        break;
+
+                    case OperationLDY:
+                        regs.y = Load(address, regs.cycles);
+                        regs.znResult = regs.y;
+                        break;
+
+                    case OperationSTA:
+                        Store(address, regs.a, regs.cycles);
+                        break;
+
+                    case OperationSTX:
+                        Store(address, regs.x, regs.cycles);
+                        break;
+
+                    case OperationSTY:
+                        Store(address, regs.y, regs.cycles);
+                        break;
+
+                    case OperationAND:
+                        regs.a &= Load(address, regs.cycles);
+                        regs.znResult = regs.a;
+                        break;
+
+                    case OperationORA:
+                        regs.a |= Load(address, regs.cycles);
+                        regs.znResult = regs.a;
+                        break;
+
+                    case OperationEOR:
+                        regs.a ^= Load(address, regs.cycles);
+                        regs.znResult = regs.a;
+                        break;
+
+                    case OperationADC:
+                        value = Load(address, regs.cycles);
+                        if (regs.flags & FLAG_DECIMAL)
+                        {
+                            StoreRegisters(regs);
+                            ADC(value);
+                            LoadRegisters(regs);
+                            break;
+                        }
+                        result = regs.a + value + (regs.flags & FLAG_CARRY);
+                        regs.flags &= ~(FLAG_CARRY | FLAG_OVERFLOW);
+                        if ((regs.a ^ result) & (value ^ result) & 0x80)
+                            regs.flags |= FLAG_OVERFLOW;
+                        if (result > 0xFF)
+                            regs.flags |= FLAG_CARRY;
+                        regs.a = (unsigned char)result;
+                        regs.znResult = regs.a;
+                        break;
+
+                    case OperationSBC:
+                        value = Load(address, regs.cycles);
+                        if (regs.flags & FLAG_DECIMAL)
+                        {
+                            StoreRegisters(regs);
+                            SBC(value);
+                            LoadRegisters(regs);
+                            break;
+                        }
+                        result = 0xFF + regs.a - value + (regs.flags & FLAG_CARRY);
+                        regs.flags &= ~(FLAG_CARRY | FLAG_OVERFLOW);
+                        if ((regs.a ^ result) & (~value ^ result) & 0x80)
+                            regs.flags |= FLAG_OVERFLOW;
+                        if (result > 0xFF)
+                            regs.flags |= FLAG_CARRY;
+                        regs.a = (unsigned char)result;
+                        regs.znResult = regs.a;
+                        break;
+
+                    case OperationCMP:
+                        value = Load(address, regs.cycles);
+                        regs.flags = (unsigned char)((regs.flags & ~FLAG_CARRY) | (regs.a >= value ? FLAG_CARRY : 0));
+                        regs.znResult = (unsigned char)(regs.a - value);
+                        break;
+
+                    case OperationCPX:
+                        value = Load(address, regs.cycles);
+                        regs.flags = (unsigned char)((regs.flags & ~FLAG_CARRY) | (regs.x >= value ? FLAG_CARRY : 0));
+                        regs.znResult = (unsigned char)(regs.x - value);
+                        break;
+
+                    case OperationCPY:
+                        value = Load(address, regs.cycles);
+                        regs.flags = (unsigned char)((regs.flags & ~FLAG_CARRY) | (regs.y >= value ? FLAG_CARRY : 0));
+                        regs.znResult = (unsigned char)(regs.y - value);
+                        break;
+
+                    case OperationBIT:
+                        value = Load(address, regs.cycles);
+                        regs.flags = (unsigned char)((regs.flags & ~FLAG_OVERFLOW) | (value & FLAG_OVERFLOW));
+                        regs.znResult = (unsigned short)((value & regs.a) | ((value & 0x80) << 1));
+                        break;
+
+                    case OperationINC:
+                        value = (unsigned char)(Load(address, regs.cycles) + 1);
+                        regs.znResult = value;
+                        Store(address, value, regs.cycles);
+                        break;
+
+                    case OperationDEC:
+                        value = (unsigned char)(Load(address, regs.cycles) - 1);
+                        regs.znResult = value;
+                        Store(address, value, regs.cycles);
+                        break;
+
+                    case OperationASLAccumulator:
+                        regs.flags = (unsigned char)((regs.flags & ~FLAG_CARRY) | (regs.a >> 7));
+                        regs.a <<= 1;
+                        regs.znResult = regs.a;
+                        break;
+
+                    case OperationASL:
+                        value = Load(address, regs.cycles);
+                        regs.flags = (unsigned char)((regs.flags & ~FLAG_CARRY) | (value >> 7));
+                        value <<= 1;
+                        regs.znResult = value;
+                        Store(address, value, regs.cycles);
+                        break;
+
+                    case OperationLSRAccumulator:
+                        regs.flags = (unsigned char)((regs.flags & ~FLAG_CARRY) | (regs.a & FLAG_CARRY));
+                        regs.a >>= 1;
+                        regs.znResult = regs.a;
+                        break;
+
+                    case OperationLSR:
+                        value = Load(address, regs.cycles);
+                        regs.flags = (unsigned char)((regs.flags & ~FLAG_CARRY) | (value & FLAG_CARRY));
+                        value >>= 1;
+                        regs.znResult = value;
+                        Store(address, value, regs.cycles);
+                        break;
+
+                    case OperationROLAccumulator:
+                        value = (unsigned char)((regs.a << 1) | (regs.flags & FLAG_CARRY));
+                        regs.flags = (unsigned char)((regs.flags & ~FLAG_CARRY) | (regs.a >> 7));
+                        regs.a = value;
+                        regs.znResult = value;
+                        break;
+
+                    case OperationROL:
+                        value = Load(address, regs.cycles);
+                        result = (value << 1) | (regs.flags & FLAG_CARRY);
+                        regs.flags = (unsigned char)((regs.flags & ~FLAG_CARRY) | (value >> 7));
+                        regs.znResult = (unsigned char)result;
+                        Store(address, (unsigned char)result, regs.cycles);
+                        break;
+
+                    case OperationRORAccumulator:
+                        value = (unsigned char)((regs.a >> 1) | ((regs.flags & FLAG_CARRY) << 7));
+                        regs.flags = (unsigned char)((regs.flags & ~FLAG_CARRY) | (regs.a & FLAG_CARRY));
+                        regs.a = value;
+                        regs.znResult = value;
+                        break;
+
+                    case OperationROR:
+                        value = Load(address, regs.cycles);
+                        result = (value >> 1) | ((regs.flags & FLAG_CARRY) << 7);
+                        regs.flags = (unsigned char)((regs.flags & ~FLAG_CARRY) | (value & FLAG_CARRY));
+                        regs.znResult = (unsigned char)result;
+                        Store(address, (unsigned char)result, regs.cycles);
+                        break;
+
+                    case OperationINX:
+                        regs.znResult = ++regs.x;
+                        break;
+
+                    case OperationINY:
+                        regs.znResult = ++regs.y;
+                        break;
+
+                    case OperationDEX:
+                        regs.znResult = --regs.x;
+                        break;
+
+                    case OperationDEY:
+                        regs.znResult = --regs.y;
+                        break;
+
+                    case OperationTAX:
+                        regs.znResult = regs.x = regs.a;
+                        break;
+
+                    case OperationTAY:
+                        regs.znResult = regs.y = regs.a;
+                        break;
+
+                    case OperationTSX:
+                        regs.znResult = regs.x = regs.sp;
+                        break;
+
+                    case OperationTXA:
+                        regs.znResult = regs.a = regs.x;
+                        break;
+
+                    case OperationTXS:
+                        regs.sp = regs.x;
+                        break;
+
+                    case OperationTYA:
+                        regs.znResult = regs.a = regs.y;
+                        break;
+
+                    case OperationCLC:
+                        regs.flags &= ~FLAG_CARRY;
+                        break;
+
+                    case OperationSEC:
+                        regs.flags |= FLAG_CARRY;
+                        break;
+
+                    case OperationCLV:
+                        regs.flags &= ~FLAG_OVERFLOW;
+                        break;
+
+                    case OperationCLD:
+                        regs.flags &= ~FLAG_DECIMAL;
+                        break;
+
+                    case OperationSED:
+                        regs.flags |= FLAG_DECIMAL;
+                        break;
+
+                    case OperationSEI:
+                        regs.flags |= FLAG_INTERRUPT;
+                        break;
+
+                    case OperationCLI:
+                        regs.flags &= ~FLAG_INTERRUPT;
+                        break;
+
+                    case OperationNOP:
+                        break;
+
+                    case OperationPHA:
+                        _ram.WriteRAM((unsigned short)(regs.sp-- | 0x0100), regs.a);
+                        break;
+
+                    case OperationPHP:
+                        _ram.WriteRAM((unsigned short)(regs.sp-- | 0x0100), Status(regs.flags, regs.znResult));
+                        break;
+
+                    case OperationPLA:
+                        regs.a = _ram.ReadRAM((unsigned short)(++regs.sp | 0x0100));
+                        regs.znResult = regs.a;
+                        break;
+
+                    case OperationJMP:
+                        regs.pc = address;
+                        break;
+
+                    case OperationJSR:
+                        --regs.pc;
+                        _ram.WriteRAM((unsigned short)(regs.sp-- | 0x0100), (unsigned char)(regs.pc >> 8));
+                        _ram.WriteRAM((unsigned short)(regs.sp-- | 0x0100), (unsigned char)(regs.pc & 0xFF));
+                        regs.pc = address;
+                        break;
+
+                    case OperationRTS:
+                        regs.pc = _ram.ReadRAM((unsigned short)(++regs.sp | 0x0100));
+                        regs.pc |= _ram.ReadRAM((unsigned short)(++regs.sp | 0x0100)) << 8;
+                        ++regs.pc;
+                        break;
+
+                    case OperationBPL:
+                        if ((regs.znResult & 0x180) == 0)
+                            Branch(regs, address);
+                        break;
+
+                    case OperationBMI:
+                        if ((regs.znResult & 0x180) != 0)
+                            Branch(regs, address);
+                        break;
+
+                    case OperationBVC:
+                        if ((regs.flags & FLAG_OVERFLOW) == 0)
+                            Branch(regs, address);
+                        break;
+
+                    case OperationBVS:
+                        if ((regs.flags & FLAG_OVERFLOW) != 0)
+                            Branch(regs, address);
+                        break;
+
+                    case OperationBCC:
+                        if ((regs.flags & FLAG_CARRY) == 0)
+                            Branch(regs, address);
+                        break;
+
+                    case OperationBCS:
+                        if ((regs.flags & FLAG_CARRY) != 0)
+                            Branch(regs, address);
+                        break;
+
+                    case OperationBNE:
+                        if ((regs.znResult & 0xFF) != 0)
+                            Branch(regs, address);
+                        break;
+
+                    case OperationBEQ:
+                        if ((regs.znResult & 0xFF) == 0)
+                            Branch(regs, address);
+                        break;
+
+                    default:
+                        // Rare opcodes run their handler on the members
+                        StoreRegisters(regs);
+                        (this->*info.handler)(address);
+                        LoadRegisters(regs);
+                        break;
+                }
+
+                regs.cycles += info.cycles;
+
+                // If code was overwritten, the rest of the block may be stale
+                if (regs.cycles >= _targetCycles || _ram.CodeWrites() != codeWrites)
+                    break;
+            }
+
+            if (_jit && ++block->executions == JIT_THRESHOLD)
+                CompileBlock(*block);
+        }
+
+        // A full iteration that ended in the same state will repeat identically until the target
+        if (block->idleLoop && regs.pc == block->startAddress && IdleLoopState(regs) == idleState)
+        {
+            _cycles = regs.cycles;
+            SkipIdleLoop(regs.cycles - startCycles);
+            regs.cycles = _cycles;
+        }
+    }
+
+    StoreRegisters(regs);
+}
+
+/// <summary>
+/// Enable or disable compiling hot blocks to native code. Has no effect if the JIT is not supported.
+/// </summary>
+void MOS6502::SetJITEnabled(bool enable)
+{
+#ifdef JIT_SUPPORTED
+    if (enable && !_jit)
+    {
+        _jit = new JIT(*this, _ram);
+        if (!_jit->IsAvailable())
+        {
+            delete _jit;
+            _jit = nullptr;
+        }
+    }
+    else if (!enable && _jit)
+    {
+        DropCompiledBlocks();
+        delete _jit;
+        _jit = nullptr;
+    }
+#else
+    (void)enable;
+#endif
+}
+
+/// <summary>
+/// Take a pending reset or interrupt. Return true if the CPU state changed and no opcode should be executed.
+/// </summary>
+bool MOS6502::HandleInterrupts()
 {
     if (_reset)
     {
         // Writes are ignored at reset, so don't push anything but do modify the stack pointer
         _sp -= 3;
-        _interrupt = true;
+        SetFlag(FLAG_INTERRUPT, true);
         _pc = _ram.Read16(0xFFFC);
         _cycles = 0;
         CountCycle(7);
@@ -425,39 +1037,47 @@ void MOS6502::Process()
         _jam = false;
         _nmi = false;
         _irq = false;
-        return;
+        return true;
     }
 
     if (_jam)
     {
         _nmi = false;
         _irq = false;
-        return;
+        return true;
     }
 
     if (_nmi)
     {
         Push16(_pc);
         Push((unsigned char)(Status() & 0xEF)); // Mask off break flag
-        _interrupt = true;
+        SetFlag(FLAG_INTERRUPT, true);
         _pc = _ram.Read16(0xFFFA);
         CountCycle(7);
         _nmi = false;
         _irq = false;
-        return;
+        return true;
     }
-    else if (_irq && !_interrupt)
+    else if (_irq && !Interrupt())
     {
         Push16(_pc);
         Push((unsigned char)(Status() & 0xEF)); // Mask off break flag
-        _interrupt = true;
+        SetFlag(FLAG_INTERRUPT, true);
         _pc = _ram.Read16(0xFFFE);
         // HACK for MW4 scorepanel: do not waste cycles before IRQ
         //CountCycle(7);
         _irq = false;
-        return;
+        return true;
     }
 
+    return false;
+}
+
+/// <summary>
+/// Fetch, decode and execute the opcode at PC.
+/// </summary>
+inline void MOS6502::ExecuteOpcode()
+{
     _opcode = _ram.Read(_pc);
 
     // HACK: do not care of banking to simplify $01 handling for ingame IRQs
@@ -468,967 +1088,902 @@ void MOS6502::Process()
         _opcode = 0x60; // RTS, return from the Kernal routine
     }
 
-    _data = _ram.Read((unsigned short)(_pc + 1));
-    _address = Combine(_data, _ram.Read((unsigned short)(_pc + 2)));
+    const OpcodeInfo& info = _opcodeTable[_opcode];
+    unsigned short address = EffectiveAddress(info, FetchOperand(info));
+    _pc += info.length;
+    // Count base cycles after the handler, so that I/O hooks see the cycle count at the start of the instruction
+    (this->*info.handler)(address);
+    CountCycle(info.cycles);
+}
 
-    switch (_opcode)
+/// <summary>
+/// Fetch the raw operand bytes of the opcode at PC. Only the bytes the addressing mode needs are read.
+/// </summary>
+unsigned short MOS6502::FetchOperand(const OpcodeInfo& info)
+{
+    switch (info.mode)
     {
-        // ADC
-        case (0x69): // Immediate
-            _pc += 2;
-            ADC(_data);
-            CountCycle(2);
-            break;
-        case (0x65): // Zero Page
-            _pc += 2;
-            ADC((unsigned short)_data);
-            CountCycle(3);
-            break;
-        case (0x75): // Zero Page,X
-            _pc += 2;
-            ADC(ZeroPageX(_data));
-            CountCycle(4);
-            break;
-        case (0x6D): // Absolute
-            _pc += 3;
-            ADC(_address);
-            CountCycle(4);
-            break;
-        case (0x7D): // Absolute,X
-            _pc += 3;
-            ADC(AbsoluteX(_address, true));
-            CountCycle(4);
-            break;
-        case (0x79): // Absolute,Y
-            _pc += 3;
-            ADC(AbsoluteY(_address, true));
-            CountCycle(4);
-            break;
-        case (0x61): // Indirect,X
-            _pc += 2;
-            ADC(IndirectX(_data));
-            CountCycle(6);
-            break;
-        case (0x71): // Indirect,Y
-            _pc += 2;
-            ADC(IndirectY(_data, true));
-            CountCycle(5);
-            break;
-
-        // AND
-        case (0x29): // Immediate
-            _pc += 2;
-            AND(_data);
-            CountCycle(2);
-            break;
-        case (0x25): // Zero Page
-            _pc += 2;
-            AND((unsigned short)_data);
-            CountCycle(2);
-            break;
-        case (0x35): // Zero Page X
-            _pc += 2;
-            AND(ZeroPageX(_data));
-            CountCycle(3);
-            break;
-        case (0x2D): // Absolute
-            _pc += 3;
-            AND(_address);
-            CountCycle(4);
-            break;
-        case (0x3D): // Absolute,X
-            _pc += 3;
-            AND(AbsoluteX(_address, true));
-            CountCycle(4);
-            break;
-        case (0x39): // Absolute,Y
-            _pc += 3;
-            AND(AbsoluteY(_address, true));
-            CountCycle(4);
-            break;
-        case (0x21): // Indirect,X
-            _pc += 2;
-            AND(IndirectX(_data));
-            CountCycle(6);
-            break;
-        case (0x31): // Indirect,Y
-            _pc += 2;
-            AND(IndirectY(_data, true));
-            CountCycle(5);
-            break;
+        case ModeZeroPage:
+        case ModeZeroPageX:
+        case ModeZeroPageY:
+        case ModeIndirectX:
+        case ModeIndirectY:
+        case ModeRelative:
+            return _ram.Read((unsigned short)(_pc + 1));
+
+        case ModeAbsolute:
+        case ModeAbsoluteX:
+        case ModeAbsoluteY:
+        case ModeIndirect:
+            return _ram.Read16((unsigned short)(_pc + 1));
 
-        case (0x0A): // Accumulator
-            _pc += 1;
-            _a = ASL(_a);
-            CountCycle(2);
-            break;
-        case (0x06): // Zero Page
-            _pc += 2;
-            ASL((unsigned short)_data);
-            CountCycle(5);
-            break;
-        case (0x16): // Zero Page,X
-            _pc += 2;
-            ASL(ZeroPageX(_data));
-            CountCycle(6);
-            break;
-        case (0x0E): // Absolute
-            _pc += 3;
-            ASL(_address);
-            CountCycle(6);
-            break;
-        case (0x1E): // Absolute,X
-            _pc += 3;
-            ASL(AbsoluteX(_address));
-            CountCycle(7);
-            break;
+        default:
+            return 0;
+    }
+}
 
-        // BCC
-        case (0x90): // Relative
-            _pc += 2;
-            if (!_carry)
-                Bxx(_data);
-            CountCycle(2);
-            break;
+/// <summary>
+/// Return the effective address of the opcode at PC from its operand.
+/// </summary>
+unsigned short MOS6502::EffectiveAddress(const OpcodeInfo& info, unsigned short operand)
+{
+    switch (info.mode)
+    {
+        case ModeImmediate:
+            return (unsigned short)(_pc + 1);
 
-        // BCS
-        case (0xB0): // Relative
-            _pc += 2;
-            if (_carry)
-                Bxx(_data);
-            CountCycle(2);
-            break;
+        case ModeZeroPage:
+        case ModeAbsolute:
+            return operand;
 
-        // BEQ
-        case (0xF0): // Relative
-            _pc += 2;
-            if (_zero)
-                Bxx(_data);
-            CountCycle(2);
-            break;
+        case ModeZeroPageX:
+            return ZeroPageX((unsigned char)operand);
 
-        // BIT
-        case (0x24): // Zero Page
-            _pc += 2;
-            BIT((unsigned short)_data);
-            CountCycle(3);
-            break;
-        case (0x2C): // Absolute
-            _pc += 3;
-            BIT(_address);
-            CountCycle(4);
-            break;
+        case ModeZeroPageY:
+            return ZeroPageY((unsigned char)operand);
 
-        // BMI
-        case (0x30): // Relative
-            _pc += 2;
-            if (_negative)
-                Bxx(_data);
-            CountCycle(2);
-            break;
+        case ModeAbsoluteX:
+            return AbsoluteX(operand, info.pageCrossPenalty != 0);
 
-        // BNE
-        case (0xD0): // Relative
-            _pc += 2;
-            if (!_zero)
-                Bxx(_data);
-            CountCycle(2);
-            break;
+        case ModeAbsoluteY:
+            return AbsoluteY(operand, info.pageCrossPenalty != 0);
 
-        // BPL
-        case (0x10): // Relative
-            _pc += 2;
-            if (!_negative)
-                Bxx(_data);
-            CountCycle(2);
-            break;
-            
-        // BRK
-        case (0x00): // Implied
-            _pc += 2;
+        case ModeIndirect:
 #if BUG
-            if (_irq || _nmi || _reset) break; // Emulate the interrupt bug
+            if ((operand & 0x00FF) == 0x00FF) // Emulate the indirect jump bug
+                return (unsigned short)((_ram.Read((unsigned short)(operand & 0xFF00)) << 8) | _ram.Read(operand));
 #endif
-            Push16(_pc);
-            Push(Status());
-            _interrupt = true;
-            _pc = _ram.Read16(0xFFFE);
-            CountCycle(7);
-            break;
-            
-        // BVC
-        case (0x50): // Relative
-            _pc += 2;
-            if (!_overflow)
-                Bxx(_data);
-            CountCycle(2);
-            break;
+            return _ram.Read16(operand);
 
-        // BVS
-        case (0x70): // Relative
-            _pc += 2;
-            if (_overflow)
-                Bxx(_data);
-            CountCycle(2);
-            break;
+        case ModeIndirectX:
+            return IndirectX((unsigned char)operand);
 
-        // CLC
-        case (0x18): // Implied
-            _pc += 1;
-            _carry = false;
-            CountCycle(2);
-            break;
-        
-        // CLD
-        case (0xD8): // Implied
-            _pc += 1;
-            _decimal = false;
-            CountCycle(2);
-            break;
-            
-        // CLI
-        case (0x58): // Implied
-            _pc += 1;
-            _interrupt = false;
-            CountCycle(2);
-            break;
-            
-        // CLV
-        case (0xB8): // Implied
-            _pc += 1;
-            _overflow = false;
-            CountCycle(2);
-            break;
-            
-        // CMP
-        case (0xC9): // Immediate
-            _pc += 2;
-            Cxx(_data, _a);
-            CountCycle(2);
-            break;
-        case (0xC5): // Zero Page
-            _pc += 2;
-            Cxx((unsigned short)_data, _a);
-            CountCycle(3);
-            break;
-        case (0xD5): // Zero Page,X
-            _pc += 2;
-            Cxx(ZeroPageX(_data), _a);
-            CountCycle(4);
-            break;
-        case (0xCD): // Absolute
-            _pc += 3;
-            Cxx(_address, _a);
-            CountCycle(4);
-            break;
-        case (0xDD): // Absolute,X
-            _pc += 3;
-            Cxx(AbsoluteX(_address, true), _a);
-            CountCycle(4);
-            break;
-        case (0xD9): // Absolute,Y
-            _pc += 3;
-            Cxx(AbsoluteY(_address, true), _a);
-            CountCycle(4);
-            break;
-        case (0xC1): // Indirect,X
-            _pc += 2;
-            Cxx(IndirectX(_data), _a);
-            CountCycle(6);
-            break;
-        case (0xD1): // Indirect,Y
-            _pc += 2;
-            Cxx(IndirectY(_data, true), _a);
-            CountCycle(5);
-            break;
-            
-        // CPX
-        case (0xE0): // Immediate
-            _pc += 2;
-            Cxx(_data, _x);
-            CountCycle(2);
-            break;
-        case (0xE4): // Zero Page
-            _pc += 2;
-            Cxx((unsigned short)_data, _x);
-            CountCycle(3);
-            break;
-        case (0xEC): // Absolute
-            _pc += 3;
-            Cxx(_address, _x);
-            CountCycle(4);
-            break;
+        case ModeIndirectY:
+            return IndirectY((unsigned char)operand, info.pageCrossPenalty != 0);
 
-        // CPY
-        case (0xC0): // Immediate
-            _pc += 2;
-            Cxx(_data, _y);
-            CountCycle(2);
-            break;
-        case (0xC4): // Zero Page
-            _pc += 2;
-            Cxx((unsigned short)_data, _y);
-            CountCycle(3);
-            break;
-        case (0xCC): // Absolute
-            _pc += 3;
-            Cxx(_address, _y);
-            CountCycle(4);
-            break;
+        case ModeRelative:
+            return (unsigned short)(_pc + 2 + (signed char)operand);
 
-        // DEC
-        case (0xC6): // Zero Page
-            _pc += 2;
-            DEC((unsigned short)_data);
-            CountCycle(5);
-            break;
-        case (0xD6): // Zero Page,X
-            _pc += 2;
-            DEC(ZeroPageX(_data));
-            CountCycle(6);
-            break;
-        case (0xCE): // Absolute
-            _pc += 3;
-            DEC(_address);
-            CountCycle(6);
-            break;
-        case (0xDE): // Absolute,X
-            _pc += 3;
-            DEC(AbsoluteX(_address));
-            CountCycle(7);
-            break;
+        default:
+            return 0;
+    }
+}
 
-        // DEX
-        case (0xCA): // Implied
-            _pc += 1;
-            _x = Dxx(_x);
-            CountCycle(2);
-            break;
+/// <summary>
+/// Return the cached block starting at address, decoding it if necessary. Return null if the address cannot be cached.
+/// </summary>
+MOS6502::CodeBlock* MOS6502::GetBlock(unsigned short address)
+{
+    CodeBlock* block = _blocks[address];
+    if (block)
+    {
+        if (block->pageGenerations[0] == _ram.PageGeneration(block->startAddress >> 8) &&
+            block->pageGenerations[1] == _ram.PageGeneration(block->lastAddress >> 8))
+        {
+            ++_blockHits;
+            return block;
+        }
+
+        // Code was overwritten since decoding
+        ++_blockInvalidations;
+        block->compiled = nullptr;
+        block->executions = 0;
+    }
+    else
+    {
+        if (!IsCacheable(address))
+            return nullptr;
+        block = new CodeBlock();
+        _blocks[address] = block;
+    }
 
-        // DEY
-        case (0x88): // Implied
-            _pc += 1;
-            _y = Dxx(_y);
-            CountCycle(2);
-            break;
+    ++_blockMisses;
+    if (!DecodeBlock(*block, address))
+    {
+        delete block;
+        _blocks[address] = nullptr;
+        return nullptr;
+    }
+    return block;
+}
 
-        // EOR
-        case (0x49): // Immediate
-            _pc += 2;
-            EOR(_data);
-            CountCycle(2);
-            break;
-        case (0x45): // Zero Page
-            _pc += 2;
-            EOR((unsigned short)_data);
-            CountCycle(3);
-            break;
-        case (0x55): // Zero Page,X
-            _pc += 2;
-            EOR(ZeroPageX(_data));
-            CountCycle(4);
-            break;
-        case (0x4D): // Absolute
-            _pc += 3;
-            EOR(_address);
-            CountCycle(4);
-            break;
-        case (0x5D): // Absolute,X
-            _pc += 3;
-            EOR(AbsoluteX(_address, true));
-            CountCycle(4);
-            break;
-        case (0x59): // Absolute,Y
-            _pc += 3;
-            EOR(AbsoluteY(_address, true));
-            CountCycle(4);
-            break;
-        case (0x41): // Indirect,X
-            _pc += 2;
-            EOR(IndirectX(_data));
-            CountCycle(6);
-            break;
-        case (0x51): // Indirect,Y
-            _pc += 2;
-            EOR(IndirectY(_data, true));
-            CountCycle(5);
-            break;
+/// <summary>
+/// Decode straight-line code starting at address into the block. Return false if nothing could be decoded.
+/// </summary>
+bool MOS6502::DecodeBlock(CodeBlock& block, unsigned short address)
+{
+    unsigned short pc = address;
+    block.startAddress = address;
+    block.numOpcodes = 0;
 
-        // INC
-        case (0xE6): // Zero Page
-            _pc += 2;
-            INC((unsigned short)_data);
-            CountCycle(5);
-            break;
-        case (0xF6): // Zero Page,X
-            _pc += 2;
-            INC(ZeroPageX(_data));
-            CountCycle(6);
-            break;
-        case (0xEE): // Absolute
-            _pc += 3;
-            INC(_address);
-            CountCycle(6);
-            break;
-        case (0xFE): // Absolute,X
-            _pc += 3;
-            INC(AbsoluteX(_address));
-            CountCycle(7);
+    while (block.numOpcodes < MAX_BLOCK_OPCODES)
+    {
+        unsigned char opcode = _ram.ReadRAM(pc);
+        const OpcodeInfo& info = _opcodeTable[opcode];
+        unsigned short last = (unsigned short)(pc + (info.length > 0 ? info.length - 1 : 0));
+        if (!IsCacheable(last))
+            break;
+
+        DecodedOpcode& decoded = block.opcodes[block.numOpcodes++];
+        decoded.info = &info;
+        decoded.operation = _operations[opcode];
+        decoded.operand = 0;
+        if (info.length == 2)
+            decoded.operand = _ram.ReadRAM((unsigned short)(pc + 1));
+        else if (info.length == 3)
+            decoded.operand = (unsigned short)(_ram.ReadRAM((unsigned short)(pc + 1)) | (_ram.ReadRAM((unsigned short)(pc + 2)) << 8));
+
+        // Immediate operands are read at execution time, so writes to them do not need to invalidate the block
+        _ram.MarkCode(pc);
+        if (info.mode != ModeImplied && info.mode != ModeImmediate)
+        {
+            for (unsigned short i = pc + 1; i <= last; ++i)
+                _ram.MarkCode(i);
+        }
+
+        block.lastAddress = last;
+        pc = (unsigned short)(last + 1);
+
+        if (EndsBlock(info))
             break;
+    }
 
-        // INX
-        case (0xE8): // Implied
-            _pc += 1;
-            _x = Ixx(_x);
-            CountCycle(2);
-            break;
+    if (!block.numOpcodes)
+        return false;
 
-        // INY
-        case (0xC8): // Implied
-            _pc += 1;
-            _y = Ixx(_y);
-            CountCycle(2);
-            break;
+    block.idleLoop = IsIdleLoop(block);
+    block.pageGenerations[0] = _ram.PageGeneration(block.startAddress >> 8);
+    block.pageGenerations[1] = _ram.PageGeneration(block.lastAddress >> 8);
+    return true;
+}
+
+/// <summary>
+/// Return whether the opcode changes the program flow or interrupt state. Interrupts are only checked between blocks,
+/// so blocks must end after CLI / PLP.
+/// </summary>
+bool MOS6502::EndsBlock(const OpcodeInfo& info) const
+{
+    return info.mode == ModeRelative ||
+        info.handler == &MOS6502::JMP ||
+        info.handler == &MOS6502::JSR ||
+        info.handler == &MOS6502::RTS ||
+        info.handler == &MOS6502::RTI ||
+        info.handler == &MOS6502::BRK ||
+        info.handler == &MOS6502::KIL ||
+        info.handler == &MOS6502::CLI ||
+        info.handler == &MOS6502::PLP;
+}
+
+/// <summary>
+/// Return the operation that the interpreter and the JIT execute inline for an opcode, or OperationFallback if the
+/// opcode handler must be called.
+/// </summary>
+Operation MOS6502::Classify(const OpcodeInfo& info)
+{
+    struct HandlerOperation
+    {
+        OpcodeHandler handler;
+        Operation operation;
+    };
+
+    static const HandlerOperation operations[] = {
+        { &MOS6502::LDA, OperationLDA }, { &MOS6502::LDX, OperationLDX }, { &MOS6502::LDY, OperationLDY },
+        { &MOS6502::STA, OperationSTA }, { &MOS6502::STX, OperationSTX }, { &MOS6502::STY, OperationSTY },
+        { &MOS6502::AND, OperationAND }, { &MOS6502::ORA, OperationORA }, { &MOS6502::EOR, OperationEOR },
+        { &MOS6502::ADC, OperationADC }, { &MOS6502::SBC, OperationSBC },
+        { &MOS6502::CMP, OperationCMP }, { &MOS6502::CPX, OperationCPX }, { &MOS6502::CPY, OperationCPY },
+        { &MOS6502::BIT, OperationBIT }, { &MOS6502::INC, OperationINC }, { &MOS6502::DEC, OperationDEC },
+        { &MOS6502::ASL, OperationASL }, { &MOS6502::LSR, OperationLSR },
+        { &MOS6502::ROL, OperationROL }, { &MOS6502::ROR, OperationROR },
+        { &MOS6502::ASLAccumulator, OperationASLAccumulator }, { &MOS6502::LSRAccumulator, OperationLSRAccumulator },
+        { &MOS6502::ROLAccumulator, OperationROLAccumulator }, { &MOS6502::RORAccumulator, OperationRORAccumulator },
+        { &MOS6502::INX, OperationINX }, { &MOS6502::INY, OperationINY },
+        { &MOS6502::DEX, OperationDEX }, { &MOS6502::DEY, OperationDEY },
+        { &MOS6502::TAX, OperationTAX }, { &MOS6502::TAY, OperationTAY }, { &MOS6502::TSX, OperationTSX },
+        { &MOS6502::TXA, OperationTXA }, { &MOS6502::TXS, OperationTXS }, { &MOS6502::TYA, OperationTYA },
+        { &MOS6502::CLC, OperationCLC }, { &MOS6502::SEC, OperationSEC }, { &MOS6502::CLV, OperationCLV },
+        { &MOS6502::CLD, OperationCLD }, { &MOS6502::SED, OperationSED }, { &MOS6502::SEI, OperationSEI },
+        { &MOS6502::CLI, OperationCLI }, { &MOS6502::NOP, OperationNOP },
+        { &MOS6502::PHA, OperationPHA }, { &MOS6502::PHP, OperationPHP }, { &MOS6502::PLA, OperationPLA },
+        { &MOS6502::JMP, OperationJMP }, { &MOS6502::JSR, OperationJSR }, { &MOS6502::RTS, OperationRTS },
+        { &MOS6502::BCC, OperationBCC }, { &MOS6502::BCS, OperationBCS },
+        { &MOS6502::BEQ, OperationBEQ }, { &MOS6502::BNE, OperationBNE },
+        { &MOS6502::BMI, OperationBMI }, { &MOS6502::BPL, OperationBPL },
+        { &MOS6502::BVC, OperationBVC }, { &MOS6502::BVS, OperationBVS }
+    };
+
+    // Indirect jumps and the illegal NOPs with operands are left to the handlers
+    if (info.mode == ModeIndirect || (info.handler == &MOS6502::NOP && info.mode != ModeImplied))
+        return OperationFallback;
+
+    for (unsigned i = 0; i < sizeof operations / sizeof operations[0]; ++i)
+    {
+        if (info.handler == operations[i].handler)
+            return operations[i].operation;
+    }
+    return OperationFallback;
+}
+
+/// <summary>
+/// Compile a hot block to native code.
+/// </summary>
+void MOS6502::CompileBlock(CodeBlock& block)
+{
+#ifdef JIT_SUPPORTED
+    block.compiled = _jit->Compile(block);
+    if (!block.compiled)
+    {
+        // Arena full, start over. Hot blocks will be compiled again
+        DropCompiledBlocks();
+        _jit->Flush();
+    }
+#else
+    (void)block;
+#endif
+}
+
+void MOS6502::DropCompiledBlocks()
+{
+    for (unsigned i = 0; i < 65536; ++i)
+    {
+        if (_blocks[i])
+        {
+            _blocks[i]->compiled = nullptr;
+            _blocks[i]->executions = 0;
+        }
+    }
+}
+
+/// <summary>
+/// Return whether code at address can be cached. The I/O area and the Kernal trap region are always interpreted.
+/// </summary>
+bool MOS6502::IsCacheable(unsigned short address) const
+{
+    return address < 0xd000 || (address >= 0xe000 && address < 0xff00);
+}
+
+/// <summary>
+/// Return whether the block is a tight loop back to its own start that only reads memory and changes registers, for
+/// example polling the raster line or a flag set by an interrupt handler. Such a loop cannot change its own
+/// behavior, so once an iteration leaves the CPU state unchanged, every later iteration is identical as well.
+/// </summary>
+bool MOS6502::IsIdleLoop(const CodeBlock& block) const
+{
+    const DecodedOpcode& last = block.opcodes[block.numOpcodes - 1];
+    const OpcodeInfo& lastInfo = *last.info;
+    if (lastInfo.mode == ModeRelative)
+    {
+        unsigned short target = (unsigned short)(block.lastAddress + 1 + (signed char)last.operand);
+        if (target != block.startAddress)
+            return false;
+    }
+    else if (lastInfo.handler != &MOS6502::JMP || lastInfo.mode != ModeAbsolute || last.operand != block.startAddress)
+        return false;
 
-        // JMP
-        case (0x4C): // Absolute
-            _pc = _address;
-            CountCycle(3);
+    for (int i = 0; i < block.numOpcodes - 1; ++i)
+    {
+        if (!IsIdleSafe(block.opcodes[i]))
+            return false;
+    }
+    return true;
+}
+
+/// <summary>
+/// Return whether an opcode inside an idle loop has no side effects. Reads are allowed from RAM and from I/O
+/// registers whose value stays the same for the duration of RunUntil.
+/// </summary>
+bool MOS6502::IsIdleSafe(const DecodedOpcode& decoded) const
+{
+    static const OpcodeHandler safeHandlers[] = {
+        &MOS6502::LDA, &MOS6502::LDX, &MOS6502::LDY, &MOS6502::CMP, &MOS6502::CPX, &MOS6502::CPY,
+        &MOS6502::BIT, &MOS6502::AND, &MOS6502::ORA, &MOS6502::EOR, &MOS6502::ADC, &MOS6502::SBC,
+        &MOS6502::TAX, &MOS6502::TAY, &MOS6502::TXA, &MOS6502::TYA, &MOS6502::TSX,
+        &MOS6502::INX, &MOS6502::INY, &MOS6502::DEX, &MOS6502::DEY,
+        &MOS6502::CLC, &MOS6502::SEC, &MOS6502::CLV, &MOS6502::CLD, &MOS6502::SED, &MOS6502::NOP,
+        &MOS6502::ASLAccumulator, &MOS6502::LSRAccumulator, &MOS6502::ROLAccumulator, &MOS6502::RORAccumulator
+    };
+
+    const OpcodeInfo& info = *decoded.info;
+    bool safe = false;
+    for (unsigned i = 0; i < sizeof safeHandlers / sizeof safeHandlers[0]; ++i)
+    {
+        if (info.handler == safeHandlers[i])
+        {
+            safe = true;
             break;
+        }
+    }
+    if (!safe)
+        return false;
 
-        case (0x6C): // Indirect
+    switch (info.mode)
+    {
+        case ModeImplied:
+        case ModeImmediate:
+        case ModeZeroPage:
+        case ModeZeroPageX:
+        case ModeZeroPageY:
+            return true;
+
+        case ModeAbsolute:
+            return _ram.IsStableRead(decoded.operand);
+
+        case ModeAbsoluteX:
+        case ModeAbsoluteY:
+            for (unsigned i = 0; i < 256; ++i)
             {
-                unsigned short address = _address;
+                if (!_ram.IsStableRead((unsigned short)(decoded.operand + i)))
+                    return false;
+            }
+            return true;
+
+        default:
+            // Indirect addresses are not known in advance
+            return false;
+    }
+}
+
+/// <summary>
+/// Return the CPU state that determines the next idle loop iteration.
+/// </summary>
+unsigned long long MOS6502::IdleLoopState(const Registers& regs) const
+{
+    return (unsigned long long)regs.a | ((unsigned long long)regs.x << 8) | ((unsigned long long)regs.y << 16) |
+        ((unsigned long long)regs.sp << 24) | ((unsigned long long)Status(regs.flags, regs.znResult) << 32);
+}
+
+/// <summary>
+/// Skip whole idle loop iterations, stopping at the start of the last iteration the loop would begin before the target.
+/// The cycle count stays exactly as if the loop had run.
+/// </summary>
+void MOS6502::SkipIdleLoop(int loopCycles)
+{
+    if (_cycles >= _targetCycles)
+        return;
+
+    int iterations = (_targetCycles - _cycles - 1) / loopCycles;
+    _cycles += iterations * loopCycles;
+    _idleCyclesSkipped += iterations * loopCycles;
+}
+
+// Opcode handlers. The effective address has already been resolved and the PC advanced past the operand
+
+void MOS6502::ASLAccumulator(unsigned short /*address*/)
+{
+    _a = ASL(_a);
+}
+
+void MOS6502::BCC(unsigned short address)
+{
+    if (!Carry())
+        Bxx(address);
+}
+
+void MOS6502::BCS(unsigned short address)
+{
+    if (Carry())
+        Bxx(address);
+}
+
+void MOS6502::BEQ(unsigned short address)
+{
+    if (Zero())
+        Bxx(address);
+}
+
+void MOS6502::BMI(unsigned short address)
+{
+    if (Negative())
+        Bxx(address);
+}
+
+void MOS6502::BNE(unsigned short address)
+{
+    if (!Zero())
+        Bxx(address);
+}
+
+void MOS6502::BPL(unsigned short address)
+{
+    if (!Negative())
+        Bxx(address);
+}
+
+void MOS6502::BRK(unsigned short /*address*/)
+{
 #if BUG
-                if ((address & 0x00FF) == 0x00FF) // Emulate the indirect jump bug
-                    _pc = (unsigned short)((_ram.Read((unsigned short)(address & 0xFF00)) << 8) | _ram.Read(address));
-                else
+    if (_irq || _nmi || _reset) return; // Emulate the interrupt bug
 #endif
-                _pc = _ram.Read16(address);
-                CountCycle(5);
-            }
-            break;
+    Push16(_pc);
+    Push(Status());
+    SetFlag(FLAG_INTERRUPT, true);
+    _pc = _ram.Read16(0xFFFE);
+}
 
-        // JSR
-        case (0x20): // Absolute
-            Push16((unsigned short)(_pc + 2)); // + 3 - 1
-            _pc = _address;
-            CountCycle(6);
-            break;
+void MOS6502::BVC(unsigned short address)
+{
+    if (!Overflow())
+        Bxx(address);
+}
 
-        // LDA
-        case (0xA9): // Immediate
-            _pc += 2;
-            LDA(_data);
-            CountCycle(2);
-            break;
-        case (0xA5): // Zero Page
-            _pc += 2;
-            LDA((unsigned short)_data);
-            CountCycle(3);
-            break;
-        case (0xB5): // Zero Page,X
-            _pc += 2;
-            LDA(ZeroPageX(_data));
-            CountCycle(4);
-            break;
-        case (0xAD): // Absolute
-            _pc += 3;
-            LDA(_address);
-            CountCycle(4);
-            break;
-        case (0xBD): // Absolute,X
-            _pc += 3;
-            LDA(AbsoluteX(_address, true));
-            CountCycle(4);
-            break;
-        case (0xB9): // Absolute,Y
-            _pc += 3;
-            LDA(AbsoluteY(_address, true));
-            CountCycle(4);
-            break;
-        case (0xA1): // Indirect,X
-            _pc += 2;
-            LDA(IndirectX(_data));
-            CountCycle(6);
-            break;
-        case (0xB1): // Indirect,Y
-            _pc += 2;
-            LDA(IndirectY(_data, true));
-            CountCycle(5);
-            break;
+void MOS6502::BVS(unsigned short address)
+{
+    if (Overflow())
+        Bxx(address);
+}
 
-        // LDX
-        case (0xA2): // Immediate
-            _pc += 2;
-            LDX(_data);
-            CountCycle(2);
-            break;
-        case (0xA6): // Zero Page
-            _pc += 2;
-            LDX((unsigned short)_data);
-            CountCycle(3);
-            break;
-        case (0xB6): // Zero Page,Y
-            _pc += 2;
-            LDX(ZeroPageY(_data));
-            CountCycle(4);
-            break;
-        case (0xAE): // Absolute
-            _pc += 3;
-            LDX(_address);
-            CountCycle(4);
-            break;
-        case (0xBE): // Absolute,Y
-            _pc += 3;
-            LDX(AbsoluteY(_address, true));
-            CountCycle(4);
-            break;
-            
-        // LDY
-        case (0xA0): // Immediate
-            _pc += 2;
-            LDY(_data);
-            CountCycle(2);
-            break;
-        case (0xA4): // Zero Page
-            _pc += 2;
-            LDY((unsigned short)_data);
-            CountCycle(3);
-            break;
-        case (0xB4): // Zero Page,X
-            _pc += 2;
-            LDY(ZeroPageX(_data));
-            CountCycle(4);
-            break;
-        case (0xAC): // Absolute
-            _pc += 3;
-            LDY(_address);
-            CountCycle(4);
-            break;
-        case (0xBC): // Absolute,X
-            _pc += 3;
-            LDY(AbsoluteX(_address, true));
-            CountCycle(4);
-            break;
-            
-        // LSR
-        case (0x4A): // Accumulator
-            _pc += 1;
-            _a = LSR(_a);
-            CountCycle(2);
-            break;
-        case (0x46): // Zero Page
-            _pc += 2;
-            LSR((unsigned short)_data);
-            CountCycle(5);
-            break;
-        case (0x56): // Zero Page,X
-            _pc += 2;
-            LSR(ZeroPageX(_data));
-            CountCycle(6);
-            break;
-        case (0x4E): // Absolute
-            _pc += 3;
-            LSR(_address);
-            CountCycle(6);
-            break;
-        case (0x5E): // Absolute,X
-            _pc += 3;
-            LSR(AbsoluteX(_address));
-            CountCycle(7);
-            break;
+void MOS6502::CLC(unsigned short /*address*/)
+{
+    SetFlag(FLAG_CARRY, false);
+}
 
-        // NOP
-        case(0xEA): // Implied
-            _pc += 1;
-            CountCycle(2);
-            break;
-            
-        // ORA
-        case (0x09): // Immediate
-            _pc += 2;
-            ORA(_data);
-            CountCycle(2);
-            break;
-        case (0x05): // Zero Page
-            _pc += 2;
-            ORA((unsigned short)_data);
-            CountCycle(3);
-            break;
-        case (0x15): // Zero Page,X
-            _pc += 2;
-            ORA(ZeroPageX(_data));
-            CountCycle(4);
-            break;
-        case (0x0D): // Absolute
-            _pc += 3;
-            ORA(_address);
-            CountCycle(4);
-            break;
-        case (0x1D): // Absolute,X
-            _pc += 3;
-            ORA(AbsoluteX(_address, true));
-            CountCycle(4);
-            break;
-        case (0x19): // Absolute,Y
-            _pc += 3;
-            ORA(AbsoluteY(_address, true));
-            CountCycle(4);
-            break;
-        case (0x01): // Indirect,X
-            _pc += 2;
-            ORA(IndirectX(_data));
-            CountCycle(6);
-            break;
-        case (0x11): // Indirect,Y
-            _pc += 2;
-            ORA(IndirectY(_data, true));
-            CountCycle(5);
-            break;
+void MOS6502::CLD(unsigned short /*address*/)
+{
+    SetFlag(FLAG_DECIMAL, false);
+}
 
-        // PHA
-        case (0x48): // Implied
-            _pc += 1;
-            Push(_a);
-            CountCycle(3);
-            break;
+void MOS6502::CLI(unsigned short /*address*/)
+{
+    SetFlag(FLAG_INTERRUPT, false);
+}
 
-        // PHP
-        case (0x08): // Implied
-            _pc += 1;
-            Push(Status());
-            CountCycle(3);
-            break;
+void MOS6502::CLV(unsigned short /*address*/)
+{
+    SetFlag(FLAG_OVERFLOW, false);
+}
 
-        // PLA
-        case (0x68): // Implied
-            _pc += 1;
-            _a = Pop();
-            SetZN(_a);
-            CountCycle(4);
-            break;
+void MOS6502::DEX(unsigned short /*address*/)
+{
+    _x = Dxx(_x);
+}
 
-        // PLP
-        case (0x28): // Implied
-            _pc += 1;
-            SetStatus(Pop());
-            CountCycle(4);
-            break;
+void MOS6502::DEY(unsigned short /*address*/)
+{
+    _y = Dxx(_y);
+}
 
-        // ROL
-        case (0x2A): // Accumulator
-            _pc += 1;
-            _a = ROL(_a);
-            CountCycle(2);
-            break;
-        case (0x26): // Zero Page
-            _pc += 2;
-            ROL((unsigned short)_data);
-            CountCycle(5);
-            break;
-        case (0x36): // Zero Page,X
-            _pc += 2;
-            ROL(ZeroPageX(_data));
-            CountCycle(6);
-            break;
-        case (0x2E): // Absolute
-            _pc += 3;
-            ROL(_address);
-            CountCycle(6);
-            break;
-        case (0x3E): // Absolute,X
-            _pc += 3;
-            ROL(AbsoluteX(_address));
-            CountCycle(7);
-            break;
+void MOS6502::INX(unsigned short /*address*/)
+{
+    _x = Ixx(_x);
+}
 
-        // ROR
-        case (0x6A): // Accumulator
-            _pc += 1;
-            _a = ROR(_a);
-            CountCycle(2);
-            break;
-        case (0x66): // Zero Page
-            _pc += 2;
-            ROR((unsigned short)_data);
-            CountCycle(5);
-            break;
-        case (0x76): // Zero Page,X
-            _pc += 2;
-            ROR(ZeroPageX(_data));
-            CountCycle(6);
-            break;
-        case (0x6E): // Absolute
-            _pc += 3;
-            ROR(_address);
-            CountCycle(6);
-            break;
-        case (0x7E): // Absolute,X
-            _pc += 3;
-            ROR(AbsoluteX(_address));
-            CountCycle(7);
-            break;
+void MOS6502::INY(unsigned short /*address*/)
+{
+    _y = Ixx(_y);
+}
 
-        // RTI
-        case (0x40): // Implied
-            SetStatus(Pop());
-            _pc = Pop16();
-            CountCycle(6);
-            break;
+void MOS6502::JMP(unsigned short address)
+{
+    _pc = address;
+}
 
-        // RTS
-        case (0x60): // Implied
-            _pc = Pop16();
-            _pc += 1;
-            CountCycle(6);
-            break;
-            
-        // SBC
-        case (0xE9): // Immediate
-            _pc += 2;
-            SBC(_data);
-            CountCycle(2);
-            break;
-        case (0xE5): // Zero Page
-            _pc += 2;
-            SBC((unsigned short)_data);
-            CountCycle(3);
-            break;
-        case (0xF5): // Zero Page,X
-            _pc += 2;
-            SBC(ZeroPageX(_data));
-            CountCycle(4);
-            break;
-        case (0xED): // Absolute
-            _pc += 3;
-            SBC(_address);
-            CountCycle(4);
-            break;
-        case (0xFD): // Absolute,X
-            _pc += 3;
-            SBC(AbsoluteX(_address, true));
-            CountCycle(4);
-            break;
-        case (0xF9): // Absolute,Y
-            _pc += 3;
-            SBC(AbsoluteY(_address, true));
-            CountCycle(4);
-            break;
-        case (0xE1): // Indirect,X
-            _pc += 2;
-            SBC(IndirectX(_data));
-            CountCycle(6);
-            break;
-        case (0xF1): // Indirect,Y
-            _pc += 2;
-            SBC(IndirectY(_data, true));
-            CountCycle(5);
-            break;
+void MOS6502::JSR(unsigned short address)
+{
+    Push16((unsigned short)(_pc - 1));
+    _pc = address;
+}
 
-        // SEC
-        case (0x38): // Implied
-            _pc += 1;
-            _carry = true;
-            CountCycle(2);
-            break;
+void MOS6502::LSRAccumulator(unsigned short /*address*/)
+{
+    _a = LSR(_a);
+}
 
-        // SED
-        case (0xF8): // Implied
-            _pc += 1;
-            _decimal = true;
-            CountCycle(2);
-            break;
+void MOS6502::NOP(unsigned short /*address*/)
+{
+}
 
-        // SEI
-        case (0x78): // Implied
-            _pc += 1;
-            _interrupt = true;
-            CountCycle(2);
-            break;
+void MOS6502::PHA(unsigned short /*address*/)
+{
+    Push(_a);
+}
 
-        // STA
-        case (0x85): // Zero Page
-            _pc += 2;
-            _ram.Write((unsigned short)_data, _a);
-            CountCycle(3);
-            break;
-        case (0x95): // Zero Page,X
-            _pc += 2;
-            _ram.Write(ZeroPageX(_data), _a);
-            CountCycle(4);
-            break;
-        case (0x8D): // Absolute
-            _pc += 3;
-            _ram.Write(_address, _a);
-            CountCycle(4);
-            break;
-        case (0x9D): // Absolute,X
-            _pc += 3;
-            _ram.Write(AbsoluteX(_address), _a);
-            CountCycle(5);
-            break;
-        case (0x99): // Absolute,Y
-            _pc += 3;
-            _ram.Write(AbsoluteY(_address), _a);
-            CountCycle(5);
-            break;
-        case (0x81): // Indirect,X
-            _pc += 2;
-            _ram.Write(IndirectX(_data), _a);
-            CountCycle(6);
-            break;
-        case (0x91): // Indirect,Y
-            _pc += 2;
-            _ram.Write(IndirectY(_data), _a);
-            CountCycle(6);
-            break;
+void MOS6502::PHP(unsigned short /*address*/)
+{
+    Push(Status());
+}
 
-        // STX
-        case (0x86): // Zero Page
-            _pc += 2;
-            _ram.Write((unsigned short)_data, _x);
-            CountCycle(3);
-            break;
-        case (0x96): // Zero Page,Y
-            _pc += 2;
-            _ram.Write(ZeroPageY(_data), _x);
-            CountCycle(4);
-            break;
-        case (0x8E): // Absolute
-            _pc += 3;
-            _ram.Write(_address, _x);
-            CountCycle(4);
-            break;
+void MOS6502::PLA(unsigned short /*address*/)
+{
+    _a = Pop();
+    SetZN(_a);
+}
 
-        // STY
-        case (0x84): // Zero Page
-            _pc += 2;
-            _ram.Write((unsigned short)_data, _y);
-            CountCycle(3);
-            break;
-        case (0x94): // Zero Page,X
-            _pc += 2;
-            _ram.Write(ZeroPageX(_data), _y);
-            CountCycle(4);
-            break;
-        case (0x8C): // Absolute
-            _pc += 3;
-            _ram.Write(_address, _y);
-            CountCycle(4);
-            break;
+void MOS6502::PLP(unsigned short /*address*/)
+{
+    SetStatus(Pop());
+}
 
-        // TAX
-        case (0xAA): // Implied
-            _pc += 1;
-            _x = _a;
-            SetZN(_x);
-            CountCycle(2);
-            break;
+void MOS6502::ROLAccumulator(unsigned short /*address*/)
+{
+    _a = ROL(_a);
+}
 
-        // TAY
-        case (0xA8): // Implied
-            _pc += 1;
-            _y = _a;
-            SetZN(_y);
-            CountCycle(2);
-            break;
+void MOS6502::RORAccumulator(unsigned short /*address*/)
+{
+    _a = ROR(_a);
+}
 
-        // TSX
-        case (0xBA): // Implied
-            _pc += 1;
-            _x = _sp;
-            SetZN(_x);
-            CountCycle(2);
-            break;
-            
-        // TXA
-        case (0x8A): // Implied
-            _pc += 1;
-            _a = _x;
-            SetZN(_a);
-            CountCycle(2);
-            break;
+void MOS6502::RTI(unsigned short /*address*/)
+{
+    SetStatus(Pop());
+    _pc = Pop16();
+}
 
-        // TXS
-        case (0x9A): // Implied
-            _pc += 1;
-            _sp = _x;
-            CountCycle(2);
-            break;
+void MOS6502::RTS(unsigned short /*address*/)
+{
+    _pc = Pop16();
+    _pc += 1;
+}
 
-        // TYA
-        case (0x98): // Implied
-            _pc += 1;
-            _a = _y;
-            SetZN(_a);
-            CountCycle(2);
-            break;
+void MOS6502::SEC(unsigned short /*address*/)
+{
+    SetFlag(FLAG_CARRY, true);
+}
 
-        /////////////////////
-        // Illegal opcodes //
-        /////////////////////
-        
-        // ANC
-        case (0x0B): // Immediate
-        case (0x2B):
-            _pc += 2;
-            AND(_data);
-            _carry = _negative;
-            CountCycle(2);
-            break;
+void MOS6502::SED(unsigned short /*address*/)
+{
+    SetFlag(FLAG_DECIMAL, true);
+}
 
-        // KIL
-        case (0x02):
-        case (0x12):
-        case (0x22):
-        case (0x32):
-        case (0x42):
-        case (0x52):
-        case (0x62):
-        case (0x72):
-        case (0x92):
-        case (0xB2):
-        case (0xD2):
-        case (0xF2):
-            _jam = true;
-            break;
-        
-        //TODO: Count extra NOP cycles and double/triple unsigned chars
-        /*
-        // NOP
-        case (0x80):
-        case (0x82):
-        case (0xC2):
-        case (0xE2):
-        case (0x04):
-        case (0x44):
-        case (0x64):
-        case (0x89):
-        case (0x0C):
-        case (0x14):
-        case (0x34):
-        case (0x54):
-        case (0x74):
-        case (0xD4):
-        case (0xF4):
-        case (0x1A):
-        case (0x3A):
-        case (0x5A):
-        case (0x7A):
-        case (0xDA):
-        case (0xFA):
-        case (0x1C):
-        case (0x3C):
-        case (0x5C):
-        case (0x7C):
-        case (0xDC):
-        case (0xFC):
-            goto case (0xEA);
-            */
-        default:
-            _pc += 1;
-            CountCycle(2);
-            break;
-    }
+void MOS6502::SEI(unsigned short /*address*/)
+{
+    SetFlag(FLAG_INTERRUPT, true);
+}
+
+void MOS6502::STA(unsigned short address)
+{
+    _ram.Write(address, _a);
+}
+
+void MOS6502::STX(unsigned short address)
+{
+    _ram.Write(address, _x);
+}
+
+void MOS6502::STY(unsigned short address)
+{
+    _ram.Write(address, _y);
+}
+
+void MOS6502::TAX(unsigned short /*address*/)
+{
+    _x = _a;
+    SetZN(_x);
+}
+
+void MOS6502::TAY(unsigned short /*address*/)
+{
+    _y = _a;
+    SetZN(_y);
+}
+
+void MOS6502::TSX(unsigned short /*address*/)
+{
+    _x = _sp;
+    SetZN(_x);
+}
+
+void MOS6502::TXA(unsigned short /*address*/)
+{
+    _a = _x;
+    SetZN(_a);
+}
+
+void MOS6502::TXS(unsigned short /*address*/)
+{
+    _sp = _x;
+}
+
+void MOS6502::TYA(unsigned short /*address*/)
+{
+    _a = _y;
+    SetZN(_a);
+}
+
+/////////////////////
+// Illegal opcodes //
+/////////////////////
+
+void MOS6502::ANC(unsigned short address)
+{
+    AND(address);
+    SetFlag(FLAG_CARRY, Negative());
+}
+
+void MOS6502::KIL(unsigned short /*address*/)
+{
+    _jam = true;
 }
+
+// Opcode descriptor table: handler, addressing mode, length, base cycles, page crossing penalty
+// TODO: Count extra NOP cycles and double/triple bytes for the illegal NOPs
+const MOS6502::OpcodeInfo MOS6502::_opcodeTable[256] = {
+    { &MOS6502::BRK, ModeImplied, 2, 7, 0 }, // 0x00
+    { &MOS6502::ORA, ModeIndirectX, 2, 6, 0 }, // 0x01
+    { &MOS6502::KIL, ModeImplied, 0, 0, 0 }, // 0x02
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x03 (illegal)
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x04 (illegal)
+    { &MOS6502::ORA, ModeZeroPage, 2, 3, 0 }, // 0x05
+    { &MOS6502::ASL, ModeZeroPage, 2, 5, 0 }, // 0x06
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x07 (illegal)
+    { &MOS6502::PHP, ModeImplied, 1, 3, 0 }, // 0x08
+    { &MOS6502::ORA, ModeImmediate, 2, 2, 0 }, // 0x09
+    { &MOS6502::ASLAccumulator, ModeImplied, 1, 2, 0 }, // 0x0A
+    { &MOS6502::ANC, ModeImmediate, 2, 2, 0 }, // 0x0B
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x0C (illegal)
+    { &MOS6502::ORA, ModeAbsolute, 3, 4, 0 }, // 0x0D
+    { &MOS6502::ASL, ModeAbsolute, 3, 6, 0 }, // 0x0E
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x0F (illegal)
+    { &MOS6502::BPL, ModeRelative, 2, 2, 0 }, // 0x10
+    { &MOS6502::ORA, ModeIndirectY, 2, 5, 1 }, // 0x11
+    { &MOS6502::KIL, ModeImplied, 0, 0, 0 }, // 0x12
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x13 (illegal)
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x14 (illegal)
+    { &MOS6502::ORA, ModeZeroPageX, 2, 4, 0 }, // 0x15
+    { &MOS6502::ASL, ModeZeroPageX, 2, 6, 0 }, // 0x16
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x17 (illegal)
+    { &MOS6502::CLC, ModeImplied, 1, 2, 0 }, // 0x18
+    { &MOS6502::ORA, ModeAbsoluteY, 3, 4, 1 }, // 0x19
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x1A (illegal)
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x1B (illegal)
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x1C (illegal)
+    { &MOS6502::ORA, ModeAbsoluteX, 3, 4, 1 }, // 0x1D
+    { &MOS6502::ASL, ModeAbsoluteX, 3, 7, 0 }, // 0x1E
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x1F (illegal)
+    { &MOS6502::JSR, ModeAbsolute, 3, 6, 0 }, // 0x20
+    { &MOS6502::AND, ModeIndirectX, 2, 6, 0 }, // 0x21
+    { &MOS6502::KIL, ModeImplied, 0, 0, 0 }, // 0x22
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x23 (illegal)
+    { &MOS6502::BIT, ModeZeroPage, 2, 3, 0 }, // 0x24
+    { &MOS6502::AND, ModeZeroPage, 2, 2, 0 }, // 0x25
+    { &MOS6502::ROL, ModeZeroPage, 2, 5, 0 }, // 0x26
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x27 (illegal)
+    { &MOS6502::PLP, ModeImplied, 1, 4, 0 }, // 0x28
+    { &MOS6502::AND, ModeImmediate, 2, 2, 0 }, // 0x29
+    { &MOS6502::ROLAccumulator, ModeImplied, 1, 2, 0 }, // 0x2A
+    { &MOS6502::ANC, ModeImmediate, 2, 2, 0 }, // 0x2B
+    { &MOS6502::BIT, ModeAbsolute, 3, 4, 0 }, // 0x2C
+    { &MOS6502::AND, ModeAbsolute, 3, 4, 0 }, // 0x2D
+    { &MOS6502::ROL, ModeAbsolute, 3, 6, 0 }, // 0x2E
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x2F (illegal)
+    { &MOS6502::BMI, ModeRelative, 2, 2, 0 }, // 0x30
+    { &MOS6502::AND, ModeIndirectY, 2, 5, 1 }, // 0x31
+    { &MOS6502::KIL, ModeImplied, 0, 0, 0 }, // 0x32
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x33 (illegal)
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x34 (illegal)
+    { &MOS6502::AND, ModeZeroPageX, 2, 3, 0 }, // 0x35
+    { &MOS6502::ROL, ModeZeroPageX, 2, 6, 0 }, // 0x36
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x37 (illegal)
+    { &MOS6502::SEC, ModeImplied, 1, 2, 0 }, // 0x38
+    { &MOS6502::AND, ModeAbsoluteY, 3, 4, 1 }, // 0x39
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x3A (illegal)
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x3B (illegal)
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x3C (illegal)
+    { &MOS6502::AND, ModeAbsoluteX, 3, 4, 1 }, // 0x3D
+    { &MOS6502::ROL, ModeAbsoluteX, 3, 7, 0 }, // 0x3E
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x3F (illegal)
+    { &MOS6502::RTI, ModeImplied, 1, 6, 0 }, // 0x40
+    { &MOS6502::EOR, ModeIndirectX, 2, 6, 0 }, // 0x41
+    { &MOS6502::KIL, ModeImplied, 0, 0, 0 }, // 0x42
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x43 (illegal)
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x44 (illegal)
+    { &MOS6502::EOR, ModeZeroPage, 2, 3, 0 }, // 0x45
+    { &MOS6502::LSR, ModeZeroPage, 2, 5, 0 }, // 0x46
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x47 (illegal)
+    { &MOS6502::PHA, ModeImplied, 1, 3, 0 }, // 0x48
+    { &MOS6502::EOR, ModeImmediate, 2, 2, 0 }, // 0x49
+    { &MOS6502::LSRAccumulator, ModeImplied, 1, 2, 0 }, // 0x4A
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x4B (illegal)
+    { &MOS6502::JMP, ModeAbsolute, 3, 3, 0 }, // 0x4C
+    { &MOS6502::EOR, ModeAbsolute, 3, 4, 0 }, // 0x4D
+    { &MOS6502::LSR, ModeAbsolute, 3, 6, 0 }, // 0x4E
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x4F (illegal)
+    { &MOS6502::BVC, ModeRelative, 2, 2, 0 }, // 0x50
+    { &MOS6502::EOR, ModeIndirectY, 2, 5, 1 }, // 0x51
+    { &MOS6502::KIL, ModeImplied, 0, 0, 0 }, // 0x52
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x53 (illegal)
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x54 (illegal)
+    { &MOS6502::EOR, ModeZeroPageX, 2, 4, 0 }, // 0x55
+    { &MOS6502::LSR, ModeZeroPageX, 2, 6, 0 }, // 0x56
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x57 (illegal)
+    { &MOS6502::CLI, ModeImplied, 1, 2, 0 }, // 0x58
+    { &MOS6502::EOR, ModeAbsoluteY, 3, 4, 1 }, // 0x59
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x5A (illegal)
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x5B (illegal)
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x5C (illegal)
+    { &MOS6502::EOR, ModeAbsoluteX, 3, 4, 1 }, // 0x5D
+    { &MOS6502::LSR, ModeAbsoluteX, 3, 7, 0 }, // 0x5E
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x5F (illegal)
+    { &MOS6502::RTS, ModeImplied, 1, 6, 0 }, // 0x60
+    { &MOS6502::ADC, ModeIndirectX, 2, 6, 0 }, // 0x61
+    { &MOS6502::KIL, ModeImplied, 0, 0, 0 }, // 0x62
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x63 (illegal)
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x64 (illegal)
+    { &MOS6502::ADC, ModeZeroPage, 2, 3, 0 }, // 0x65
+    { &MOS6502::ROR, ModeZeroPage, 2, 5, 0 }, // 0x66
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x67 (illegal)
+    { &MOS6502::PLA, ModeImplied, 1, 4, 0 }, // 0x68
+    { &MOS6502::ADC, ModeImmediate, 2, 2, 0 }, // 0x69
+    { &MOS6502::RORAccumulator, ModeImplied, 1, 2, 0 }, // 0x6A
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x6B (illegal)
+    { &MOS6502::JMP, ModeIndirect, 3, 5, 0 }, // 0x6C
+    { &MOS6502::ADC, ModeAbsolute, 3, 4, 0 }, // 0x6D
+    { &MOS6502::ROR, ModeAbsolute, 3, 6, 0 }, // 0x6E
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x6F (illegal)
+    { &MOS6502::BVS, ModeRelative, 2, 2, 0 }, // 0x70
+    { &MOS6502::ADC, ModeIndirectY, 2, 5, 1 }, // 0x71
+    { &MOS6502::KIL, ModeImplied, 0, 0, 0 }, // 0x72
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x73 (illegal)
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x74 (illegal)
+    { &MOS6502::ADC, ModeZeroPageX, 2, 4, 0 }, // 0x75
+    { &MOS6502::ROR, ModeZeroPageX, 2, 6, 0 }, // 0x76
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x77 (illegal)
+    { &MOS6502::SEI, ModeImplied, 1, 2, 0 }, // 0x78
+    { &MOS6502::ADC, ModeAbsoluteY, 3, 4, 1 }, // 0x79
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x7A (illegal)
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x7B (illegal)
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x7C (illegal)
+    { &MOS6502::ADC, ModeAbsoluteX, 3, 4, 1 }, // 0x7D
+    { &MOS6502::ROR, ModeAbsoluteX, 3, 7, 0 }, // 0x7E
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x7F (illegal)
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x80 (illegal)
+    { &MOS6502::STA, ModeIndirectX, 2, 6, 0 }, // 0x81
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x82 (illegal)
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x83 (illegal)
+    { &MOS6502::STY, ModeZeroPage, 2, 3, 0 }, // 0x84
+    { &MOS6502::STA, ModeZeroPage, 2, 3, 0 }, // 0x85
+    { &MOS6502::STX, ModeZeroPage, 2, 3, 0 }, // 0x86
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x87 (illegal)
+    { &MOS6502::DEY, ModeImplied, 1, 2, 0 }, // 0x88
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x89 (illegal)
+    { &MOS6502::TXA, ModeImplied, 1, 2, 0 }, // 0x8A
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x8B (illegal)
+    { &MOS6502::STY, ModeAbsolute, 3, 4, 0 }, // 0x8C
+    { &MOS6502::STA, ModeAbsolute, 3, 4, 0 }, // 0x8D
+    { &MOS6502::STX, ModeAbsolute, 3, 4, 0 }, // 0x8E
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x8F (illegal)
+    { &MOS6502::BCC, ModeRelative, 2, 2, 0 }, // 0x90
+    { &MOS6502::STA, ModeIndirectY, 2, 6, 0 }, // 0x91
+    { &MOS6502::KIL, ModeImplied, 0, 0, 0 }, // 0x92
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x93 (illegal)
+    { &MOS6502::STY, ModeZeroPageX, 2, 4, 0 }, // 0x94
+    { &MOS6502::STA, ModeZeroPageX, 2, 4, 0 }, // 0x95
+    { &MOS6502::STX, ModeZeroPageY, 2, 4, 0 }, // 0x96
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x97 (illegal)
+    { &MOS6502::TYA, ModeImplied, 1, 2, 0 }, // 0x98
+    { &MOS6502::STA, ModeAbsoluteY, 3, 5, 0 }, // 0x99
+    { &MOS6502::TXS, ModeImplied, 1, 2, 0 }, // 0x9A
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x9B (illegal)
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x9C (illegal)
+    { &MOS6502::STA, ModeAbsoluteX, 3, 5, 0 }, // 0x9D
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x9E (illegal)
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0x9F (illegal)
+    { &MOS6502::LDY, ModeImmediate, 2, 2, 0 }, // 0xA0
+    { &MOS6502::LDA, ModeIndirectX, 2, 6, 0 }, // 0xA1
+    { &MOS6502::LDX, ModeImmediate, 2, 2, 0 }, // 0xA2
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xA3 (illegal)
+    { &MOS6502::LDY, ModeZeroPage, 2, 3, 0 }, // 0xA4
+    { &MOS6502::LDA, ModeZeroPage, 2, 3, 0 }, // 0xA5
+    { &MOS6502::LDX, ModeZeroPage, 2, 3, 0 }, // 0xA6
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xA7 (illegal)
+    { &MOS6502::TAY, ModeImplied, 1, 2, 0 }, // 0xA8
+    { &MOS6502::LDA, ModeImmediate, 2, 2, 0 }, // 0xA9
+    { &MOS6502::TAX, ModeImplied, 1, 2, 0 }, // 0xAA
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xAB (illegal)
+    { &MOS6502::LDY, ModeAbsolute, 3, 4, 0 }, // 0xAC
+    { &MOS6502::LDA, ModeAbsolute, 3, 4, 0 }, // 0xAD
+    { &MOS6502::LDX, ModeAbsolute, 3, 4, 0 }, // 0xAE
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xAF (illegal)
+    { &MOS6502::BCS, ModeRelative, 2, 2, 0 }, // 0xB0
+    { &MOS6502::LDA, ModeIndirectY, 2, 5, 1 }, // 0xB1
+    { &MOS6502::KIL, ModeImplied, 0, 0, 0 }, // 0xB2
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xB3 (illegal)
+    { &MOS6502::LDY, ModeZeroPageX, 2, 4, 0 }, // 0xB4
+    { &MOS6502::LDA, ModeZeroPageX, 2, 4, 0 }, // 0xB5
+    { &MOS6502::LDX, ModeZeroPageY, 2, 4, 0 }, // 0xB6
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xB7 (illegal)
+    { &MOS6502::CLV, ModeImplied, 1, 2, 0 }, // 0xB8
+    { &MOS6502::LDA, ModeAbsoluteY, 3, 4, 1 }, // 0xB9
+    { &MOS6502::TSX, ModeImplied, 1, 2, 0 }, // 0xBA
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xBB (illegal)
+    { &MOS6502::LDY, ModeAbsoluteX, 3, 4, 1 }, // 0xBC
+    { &MOS6502::LDA, ModeAbsoluteX, 3, 4, 1 }, // 0xBD
+    { &MOS6502::LDX, ModeAbsoluteY, 3, 4, 1 }, // 0xBE
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xBF (illegal)
+    { &MOS6502::CPY, ModeImmediate, 2, 2, 0 }, // 0xC0
+    { &MOS6502::CMP, ModeIndirectX, 2, 6, 0 }, // 0xC1
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xC2 (illegal)
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xC3 (illegal)
+    { &MOS6502::CPY, ModeZeroPage, 2, 3, 0 }, // 0xC4
+    { &MOS6502::CMP, ModeZeroPage, 2, 3, 0 }, // 0xC5
+    { &MOS6502::DEC, ModeZeroPage, 2, 5, 0 }, // 0xC6
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xC7 (illegal)
+    { &MOS6502::INY, ModeImplied, 1, 2, 0 }, // 0xC8
+    { &MOS6502::CMP, ModeImmediate, 2, 2, 0 }, // 0xC9
+    { &MOS6502::DEX, ModeImplied, 1, 2, 0 }, // 0xCA
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xCB (illegal)
+    { &MOS6502::CPY, ModeAbsolute, 3, 4, 0 }, // 0xCC
+    { &MOS6502::CMP, ModeAbsolute, 3, 4, 0 }, // 0xCD
+    { &MOS6502::DEC, ModeAbsolute, 3, 6, 0 }, // 0xCE
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xCF (illegal)
+    { &MOS6502::BNE, ModeRelative, 2, 2, 0 }, // 0xD0
+    { &MOS6502::CMP, ModeIndirectY, 2, 5, 1 }, // 0xD1
+    { &MOS6502::KIL, ModeImplied, 0, 0, 0 }, // 0xD2
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xD3 (illegal)
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xD4 (illegal)
+    { &MOS6502::CMP, ModeZeroPageX, 2, 4, 0 }, // 0xD5
+    { &MOS6502::DEC, ModeZeroPageX, 2, 6, 0 }, // 0xD6
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xD7 (illegal)
+    { &MOS6502::CLD, ModeImplied, 1, 2, 0 }, // 0xD8
+    { &MOS6502::CMP, ModeAbsoluteY, 3, 4, 1 }, // 0xD9
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xDA (illegal)
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xDB (illegal)
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xDC (illegal)
+    { &MOS6502::CMP, ModeAbsoluteX, 3, 4, 1 }, // 0xDD
+    { &MOS6502::DEC, ModeAbsoluteX, 3, 7, 0 }, // 0xDE
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xDF (illegal)
+    { &MOS6502::CPX, ModeImmediate, 2, 2, 0 }, // 0xE0
+    { &MOS6502::SBC, ModeIndirectX, 2, 6, 0 }, // 0xE1
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xE2 (illegal)
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xE3 (illegal)
+    { &MOS6502::CPX, ModeZeroPage, 2, 3, 0 }, // 0xE4
+    { &MOS6502::SBC, ModeZeroPage, 2, 3, 0 }, // 0xE5
+    { &MOS6502::INC, ModeZeroPage, 2, 5, 0 }, // 0xE6
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xE7 (illegal)
+    { &MOS6502::INX, ModeImplied, 1, 2, 0 }, // 0xE8
+    { &MOS6502::SBC, ModeImmediate, 2, 2, 0 }, // 0xE9
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xEA
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xEB (illegal)
+    { &MOS6502::CPX, ModeAbsolute, 3, 4, 0 }, // 0xEC
+    { &MOS6502::SBC, ModeAbsolute, 3, 4, 0 }, // 0xED
+    { &MOS6502::INC, ModeAbsolute, 3, 6, 0 }, // 0xEE
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xEF (illegal)
+    { &MOS6502::BEQ, ModeRelative, 2, 2, 0 }, // 0xF0
+    { &MOS6502::SBC, ModeIndirectY, 2, 5, 1 }, // 0xF1
+    { &MOS6502::KIL, ModeImplied, 0, 0, 0 }, // 0xF2
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xF3 (illegal)
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xF4 (illegal)
+    { &MOS6502::SBC, ModeZeroPageX, 2, 4, 0 }, // 0xF5
+    { &MOS6502::INC, ModeZeroPageX, 2, 6, 0 }, // 0xF6
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xF7 (illegal)
+    { &MOS6502::SED, ModeImplied, 1, 2, 0 }, // 0xF8
+    { &MOS6502::SBC, ModeAbsoluteY, 3, 4, 1 }, // 0xF9
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xFA (illegal)
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xFB (illegal)
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }, // 0xFC (illegal)
+    { &MOS6502::SBC, ModeAbsoluteX, 3, 4, 1 }, // 0xFD
+    { &MOS6502::INC, ModeAbsoluteX, 3, 7, 0 }, // 0xFE
+    { &MOS6502::NOP, ModeImplied, 1, 2, 0 }  // 0xFF (illegal)
+};
+
+/// <summary>
+/// Execute one opcode from a compiled block through the interpreter, for opcodes the JIT does not translate.
+/// </summary>
+void MOS6502::JITStep(MOS6502* cpu, unsigned opcode, unsigned operand)
+{
+    const OpcodeInfo& info = _opcodeTable[opcode];
+    unsigned short address = cpu->EffectiveAddress(info, (unsigned short)operand);
+    cpu->_pc += info.length;
+    (cpu->*info.handler)(address);
+    cpu->CountCycle(info.cycles);
+}
\ No newline at end of file
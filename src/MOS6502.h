@@ -26,16 +26,66 @@
 
 class RAM64K;
 class Emulator;
+class JIT;
+
+const int MAX_BLOCK_OPCODES = 32;
+const unsigned JIT_THRESHOLD = 64;
+
+enum StatusFlag
+{
+    FLAG_CARRY = 0x1,
+    FLAG_ZERO = 0x2,
+    FLAG_INTERRUPT = 0x4,
+    FLAG_DECIMAL = 0x8,
+    FLAG_BREAK = 0x10, // Only exists on stack
+    FLAG_OVERFLOW = 0x40,
+    FLAG_NEGATIVE = 0x80
+};
+
+enum AddressMode
+{
+    ModeImplied = 0,
+    ModeImmediate,
+    ModeZeroPage,
+    ModeZeroPageX,
+    ModeZeroPageY,
+    ModeAbsolute,
+    ModeAbsoluteX,
+    ModeAbsoluteY,
+    ModeIndirect,
+    ModeIndirectX,
+    ModeIndirectY,
+    ModeRelative
+};
+
+// Operations that the interpreter and the JIT execute inline. Anything else calls the opcode handler
+enum Operation
+{
+    OperationFallback = 0,
+    OperationLDA, OperationLDX, OperationLDY, OperationSTA, OperationSTX, OperationSTY,
+    OperationAND, OperationORA, OperationEOR, OperationADC, OperationSBC,
+    OperationCMP, OperationCPX, OperationCPY, OperationBIT,
+    OperationINC, OperationDEC, OperationASL, OperationLSR, OperationROL, OperationROR,
+    OperationASLAccumulator, OperationLSRAccumulator, OperationROLAccumulator, OperationRORAccumulator,
+    OperationINX, OperationINY, OperationDEX, OperationDEY,
+    OperationTAX, OperationTAY, OperationTSX, OperationTXA, OperationTXS, OperationTYA,
+    OperationCLC, OperationSEC, OperationCLV, OperationCLD, OperationSED, OperationSEI, OperationCLI, OperationNOP,
+    OperationPHA, OperationPHP, OperationPLA, OperationJMP, OperationJSR, OperationRTS,
+    OperationBCC, OperationBCS, OperationBEQ, OperationBNE, OperationBMI, OperationBPL, OperationBVC, OperationBVS
+};
 
 class MOS6502
 {
 public:
     MOS6502(RAM64K& ram, Emulator& emulator);
+    ~MOS6502();
     void Jump(unsigned short address);
     void SetNMI();
     void SetIRQ();
     void Reset();
     void Process();
+    void RunUntil(int targetCycles);
+    void LimitRun(int targetCycles) { if (targetCycles < _targetCycles) _targetCycles = targetCycles; }
     void SetCycles(int value) { _cycles = value; }
     void SetA(unsigned char value) { _a = value; }
     unsigned short PC() const { return _pc; }
@@ -44,10 +94,87 @@ public:
     unsigned char Y() const { return _y; }
     int Cycles() const { return _cycles; }
     bool Jam() const { return _jam; }
+    unsigned BlockCacheHits() const { return _blockHits; }
+    unsigned BlockCacheMisses() const { return _blockMisses; }
+    unsigned BlockCacheInvalidations() const { return _blockInvalidations; }
+    unsigned IdleCyclesSkipped() const { return _idleCyclesSkipped; }
+    void SetJITEnabled(bool enable);
+    bool JITEnabled() const { return _jit != nullptr; }
 
 private:
+    // Compiled code accesses the registers and block cache directly
+    friend class JIT;
+
+    typedef void (MOS6502::*OpcodeHandler)(unsigned short address);
+
+    struct OpcodeInfo
+    {
+        OpcodeHandler handler;
+        AddressMode mode;
+        unsigned char length;
+        unsigned char cycles;
+        unsigned char pageCrossPenalty;
+    };
+
+    // Straight-line code decoded once for the block cache
+    struct DecodedOpcode
+    {
+        const OpcodeInfo* info;
+        unsigned short operand;
+        unsigned char operation;
+    };
+
+    struct CodeBlock
+    {
+        unsigned short startAddress;
+        unsigned short lastAddress;
+        unsigned pageGenerations[2];
+        int numOpcodes;
+        DecodedOpcode opcodes[MAX_BLOCK_OPCODES];
+        unsigned executions;
+        void (*compiled)(MOS6502* cpu);
+        bool idleLoop;
+    };
+
+    // Working copy of the registers that RunUntil keeps in locals instead of accessing them through the object.
+    // The members are only brought up to date around code that needs the object state
+    struct Registers
+    {
+        unsigned short pc;
+        unsigned char a;
+        unsigned char x;
+        unsigned char y;
+        unsigned char sp;
+        unsigned char flags;
+        unsigned short znResult;
+        int cycles;
+    };
+
+    bool HandleInterrupts();
+    void ExecuteOpcode();
+    unsigned short FetchOperand(const OpcodeInfo& info);
+    unsigned short EffectiveAddress(const OpcodeInfo& info, unsigned short operand);
+    CodeBlock* GetBlock(unsigned short address);
+    bool DecodeBlock(CodeBlock& block, unsigned short address);
+    void LoadRegisters(Registers& regs) const;
+    void StoreRegisters(const Registers& regs);
+    unsigned char Load(unsigned short address, int cycles);
+    void Store(unsigned short address, unsigned char value, int cycles);
+    void Branch(Registers& regs, unsigned short address);
+    static Operation Classify(const OpcodeInfo& info);
+    bool EndsBlock(const OpcodeInfo& info) const;
+    bool IsCacheable(unsigned short address) const;
+    bool IsIdleLoop(const CodeBlock& block) const;
+    bool IsIdleSafe(const DecodedOpcode& decoded) const;
+    unsigned long long IdleLoopState(const Registers& regs) const;
+    void SkipIdleLoop(int loopCycles);
+    void CompileBlock(CodeBlock& block);
+    void DropCompiledBlocks();
+    static void JITStep(MOS6502* cpu, unsigned opcode, unsigned operand);
     void CountCycle(int cycles = 1);
     unsigned short Combine(unsigned char a, unsigned char b);
+    unsigned char ReadZeroPage(unsigned char address);
+    unsigned short ReadZeroPage16(unsigned char address);
     void Push(unsigned char data);
     void Push16(unsigned short data);
     unsigned char Pop();
@@ -67,16 +194,38 @@ private:
     void AND(unsigned short address);
     unsigned char ASL(unsigned char value);
     void ASL(unsigned short address);
-    void Bxx(unsigned char value);
+    void ASLAccumulator(unsigned short address);
+    void Bxx(unsigned short address);
+    void BCC(unsigned short address);
+    void BCS(unsigned short address);
+    void BEQ(unsigned short address);
     void BIT(unsigned short address);
+    void BMI(unsigned short address);
+    void BNE(unsigned short address);
+    void BPL(unsigned short address);
+    void BRK(unsigned short address);
+    void BVC(unsigned short address);
+    void BVS(unsigned short address);
+    void CLC(unsigned short address);
+    void CLD(unsigned short address);
+    void CLI(unsigned short address);
+    void CLV(unsigned short address);
     void Cxx(unsigned char value, unsigned char reg);
-    void Cxx(unsigned short address, unsigned char reg);
+    void CMP(unsigned short address);
+    void CPX(unsigned short address);
+    void CPY(unsigned short address);
     unsigned char Dxx(unsigned char value);
     void DEC(unsigned short address);
+    void DEX(unsigned short address);
+    void DEY(unsigned short address);
     void EOR(unsigned char value);
     void EOR(unsigned short address);
     unsigned char Ixx(unsigned char value);
     void INC(unsigned short address);
+    void INX(unsigned short address);
+    void INY(unsigned short address);
+    void JMP(unsigned short address);
+    void JSR(unsigned short address);
     void LDA(unsigned char value);
     void LDA(unsigned short address);
     void LDX(unsigned char value);
@@ -85,63 +234,102 @@ private:
     void LDY(unsigned short address);
     unsigned char LSR(unsigned char value);
     void LSR(unsigned short address);
+    void LSRAccumulator(unsigned short address);
+    void NOP(unsigned short address);
     void ORA(unsigned char value);
     void ORA(unsigned short address);
+    void PHA(unsigned short address);
+    void PHP(unsigned short address);
+    void PLA(unsigned short address);
+    void PLP(unsigned short address);
     unsigned char ROL(unsigned char value);
     void ROL(unsigned short address);
+    void ROLAccumulator(unsigned short address);
     unsigned char ROR(unsigned char value);
     void ROR(unsigned short address);
+    void RORAccumulator(unsigned short address);
+    void RTI(unsigned short address);
+    void RTS(unsigned short address);
     void SBC(unsigned char value);
     void SBC(unsigned short address);
+    void SEC(unsigned short address);
+    void SED(unsigned short address);
+    void SEI(unsigned short address);
+    void STA(unsigned short address);
+    void STX(unsigned short address);
+    void STY(unsigned short address);
+    void TAX(unsigned short address);
+    void TAY(unsigned short address);
+    void TSX(unsigned short address);
+    void TXA(unsigned short address);
+    void TXS(unsigned short address);
+    void TYA(unsigned short address);
+    void ANC(unsigned short address);
+    void KIL(unsigned short address);
+
+    // Z and N are evaluated lazily from the last result: Z is set if the low byte is zero, N if bit 7 or bit 8 is set.
+    // Bit 8 allows N to be set independently of Z, for BIT and PLP / RTI
+    bool Zero() const { return (_znResult & 0xff) == 0; }
+    bool Negative() const { return (_znResult & 0x180) != 0; }
+    bool Carry() const { return (_flags & FLAG_CARRY) != 0; }
+    bool Interrupt() const { return (_flags & FLAG_INTERRUPT) != 0; }
+    bool Decimal() const { return (_flags & FLAG_DECIMAL) != 0; }
+    bool Overflow() const { return (_flags & FLAG_OVERFLOW) != 0; }
+
+    void SetFlag(unsigned char flag, bool value)
+    {
+        _flags = (unsigned char)(value ? (_flags | flag) : (_flags & ~flag));
+    }
 
     unsigned char Status()
+    {
+        return Status(_flags, _znResult);
+    }
+
+    static unsigned char Status(unsigned char flags, unsigned short znResult)
     {
         return (unsigned char)
-            ((_carry ? 0x1 : 0) |
-            (_zero ? 0x2 : 0) |
-            (_interrupt ? 0x4 : 0) |
-            (_decimal ? 0x8 : 0) |
+            (flags |
+            ((znResult & 0xff) == 0 ? FLAG_ZERO : 0) |
             0x10 | //(_break ? 0x10 : 0) |
             0x20 |
-            (_overflow ? 0x40 : 0) |
-            (_negative ? 0x80 : 0));
+            ((znResult & 0x180) != 0 ? FLAG_NEGATIVE : 0));
     }
 
     void SetStatus(unsigned char value)
     {
-        _carry = (value & 0x1) != 0;
-        _zero = (value & 0x2) != 0;
-        _interrupt = (value & 0x4) != 0;
-        _decimal = (value & 0x8) != 0;
-        //_break = (value & 0x10) != 0;
-        _overflow = (value & 0x40) != 0;
-        _negative = (value & 0x80) != 0;
+        _flags = (unsigned char)(value & (FLAG_CARRY | FLAG_INTERRUPT | FLAG_DECIMAL | FLAG_OVERFLOW));
+        _znResult = (unsigned short)(((value & FLAG_ZERO) ? 0 : 1) | ((value & FLAG_NEGATIVE) << 1));
     }
 
     RAM64K& _ram;
     Emulator& _emulator;
 
+    static const OpcodeInfo _opcodeTable[256];
+    unsigned char _operations[256]; // Classify() result of each opcode, looked up when decoding
+
     unsigned char _opcode;
-    unsigned char _data;
-    unsigned short _address;
     unsigned char _a;
     unsigned char _x;
     unsigned char _y;
     unsigned char _sp;
     unsigned short _pc;
 
-    bool _carry;    //0x1
-    bool _zero;     //0x2
-    bool _interrupt;//0x4
-    bool _decimal;  //0x8
-    //bool _break;  //0x10 only exists on stack
-    //bool _unused; //0x20
-    bool _overflow; //0x40
-    bool _negative; //0x80
+    unsigned char _flags;       // C, I, D and V in their status register positions
+    unsigned short _znResult;   // Last result for Z and N
 
     bool _nmi;
     bool _irq;
     bool _reset;
     bool _jam;
     int _cycles;
+    int _targetCycles;
+
+    CodeBlock* _blocks[65536];
+    unsigned _blockHits;
+    unsigned _blockMisses;
+    unsigned _blockInvalidations;
+    unsigned _blockCodeWrites;
+    unsigned _idleCyclesSkipped;
+    JIT* _jit;
 };
\ No newline at end of file
@@ -23,6 +23,7 @@
 #include <emscripten.h>
 #include <emscripten/html5.h>
 #include "Emulator.h"
+#include "SaveData.h"
 
 const double frameTime = 1000.0 / 50.0;
 
@@ -35,26 +36,29 @@ EM_BOOL KeyCallback(int eventType, const EmscriptenKeyboardEvent *e, void *userD
 
 int main(int argc, char** argv)
 {
-    // Load old saves
-    EM_ASM(
-        FS.mkdir('/savedata');
-        FS.mount(IDBFS,{},'/savedata');
-        FS.syncfs(true, function(err) {
-            if (!err) {
-                Module.print('Savefiles initialized');
-            }
-        });
-    );
+    SaveData::Init();
 
     std::string diskImageName;
+    RenderMode renderMode = RenderImmediate;
+    bool audioThreaded = false;
     for (int i = 0; i < argc; ++i)
     {
         std::string argument(argv[i]);
         if (argument.find("diskimage=") == 0)
             diskImageName = argument.substr(10);
+        else if (argument == "render=deferred")
+            renderMode = RenderDeferred;
+        else if (argument == "render=threaded")
+            renderMode = RenderThreaded;
+        else if (argument == "audio=threaded")
+            audioThreaded = true;
     }
 
     emulator = new Emulator(diskImageName);
+    if (!emulator->IsBooted())
+        return 1;
+    emulator->SetRenderMode(renderMode);
+    emulator->SetAudioThreaded(audioThreaded);
     
     emscripten_set_main_loop(FrameCallback, 0, 0);
     emscripten_set_keydown_callback("canvas", 0, 1, KeyCallback);
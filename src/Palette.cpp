@@ -0,0 +1,69 @@
+// MIT License
+// 
+// Copyright (c) 2018-2026 Lasse Oorni
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "Palette.h"
+#include "SIMD.h"
+
+const unsigned Palette::colors[] = { 0xff000000, 0xffffffff, 0xff2b3768, 0xffb2a470, 0xff863d6f, 0xff438d58, 0xff792835, 0xff6fc7b8,
+                       0xff254f6f, 0xff003943, 0xff59679a, 0xff444444, 0xff6c6c6c, 0xff84d29a, 0xffb55e6c, 0xff959595 };
+
+void Palette::ConvertToRGBA(const unsigned char* indices, unsigned* dest, int count)
+{
+    int i = 0;
+
+#ifdef SIMD_BYTE_LOOKUP
+    // Look up each color channel for 16 pixels at a time, then interleave the channels
+    unsigned char channels[4][NUM_COLORS];
+    for (int c = 0; c < NUM_COLORS; ++c)
+    {
+        const unsigned char* color = (const unsigned char*)&colors[c];
+        for (int j = 0; j < 4; ++j)
+            channels[j][c] = color[j];
+    }
+
+    Vec128 red = Vec128Load(channels[0]);
+    Vec128 green = Vec128Load(channels[1]);
+    Vec128 blue = Vec128Load(channels[2]);
+    Vec128 alpha = Vec128Load(channels[3]);
+
+    for (; i + 16 <= count; i += 16)
+    {
+        Vec128 index = Vec128Load(indices + i);
+        Vec128 r = Vec128Lookup(red, index);
+        Vec128 g = Vec128Lookup(green, index);
+        Vec128 b = Vec128Lookup(blue, index);
+        Vec128 a = Vec128Lookup(alpha, index);
+
+        Vec128 rgLow = Vec128ZipBytesLow(r, g);
+        Vec128 rgHigh = Vec128ZipBytesHigh(r, g);
+        Vec128 baLow = Vec128ZipBytesLow(b, a);
+        Vec128 baHigh = Vec128ZipBytesHigh(b, a);
+        Vec128Store(dest + i, Vec128ZipShortsLow(rgLow, baLow));
+        Vec128Store(dest + i + 4, Vec128ZipShortsHigh(rgLow, baLow));
+        Vec128Store(dest + i + 8, Vec128ZipShortsLow(rgHigh, baHigh));
+        Vec128Store(dest + i + 12, Vec128ZipShortsHigh(rgHigh, baHigh));
+    }
+#endif
+
+    for (; i < count; ++i)
+        dest[i] = colors[indices[i]];
+}
@@ -23,43 +23,39 @@
 // Modified by Lasse Oorni for OldschoolEngine2
 
 #include "RAM64K.h"
-#include "Emulator.h"
 
-RAM64K::RAM64K(Emulator& emulator) :
-    _emulator(emulator)
+RAM64K::RAM64K() :
+    _codeWrites(0),
+    _ioVisible(false)
 {
     for (unsigned i = 0; i < sizeof(_ram); ++i)
         _ram[i] = 0x0;
     for (unsigned i = 0; i < sizeof(_ioRam); ++i)
+    {
         _ioRam[i] = 0x0;
-}
-
-unsigned char RAM64K::Read(unsigned short address)
-{
-    if ((_ram[0x01] & 0x3) == 0 || address < 0xd000 || address >= 0xe000)
-        return ReadRAM(address);
-    else
-        return ReadIO(address);
-}
-
-unsigned char RAM64K::ReadRAM(unsigned short address)
-{
-    return _ram[address];
+        _ioReaders[i] = nullptr;
+        _ioWriters[i] = nullptr;
+    }
+    for (unsigned i = 0; i < sizeof(_watchedBytes); ++i)
+        _watchedBytes[i] = 0;
+    for (unsigned i = 0; i < 256; ++i)
+    {
+        _pageGenerations[i] = 0;
+        _dataGenerations[i] = 0;
+        _pageWatchedBytes[i] = 0;
+        UpdatePage((unsigned char)i);
+    }
 }
 
 unsigned char RAM64K::ReadIO(unsigned short address, bool readInput)
 {
     if (address >= 0xd000 && address < 0xe000)
     {
-        if (readInput)
-        {
-            bool handled = false;
-            unsigned char ret = _emulator.IORead(address, handled);
-            if (handled)
-                return ret;
-        }
-
-        return _ioRam[address - 0xd000];
+        unsigned offset = address - 0xd000;
+        if (readInput && _ioReaders[offset])
+            return _ioReaders[offset]->IORead(address);
+
+        return _ioRam[offset];
     }
     else
         return _ram[address];
@@ -72,17 +68,24 @@ unsigned short RAM64K::Read16(unsigned short address)
     return (unsigned short)((b << 8) | a);
 }
 
-void RAM64K::Write(unsigned short address, unsigned char value)
+void RAM64K::WriteUnmapped(unsigned short address, unsigned char value)
 {
-    if ((_ram[0x01] & 0x3) == 0 || address < 0xd000 || address >= 0xe000)
-        WriteRAM(address, value);
-    else
+    if (_ioVisible)
         WriteIO(address, value);
+    else
+        WriteRAM(address, value);
 }
 
 void RAM64K::WriteRAM(unsigned short address, unsigned char value)
 {
+    unsigned char watch = _watchedBytes[address];
+    if ((watch & WATCH_DATA) && _ram[address] != value)
+        ++_dataGenerations[address >> 8];
     _ram[address] = value;
+    if (watch & WATCH_CODE)
+        InvalidateCode(address);
+    if (address == 0x01)
+        UpdateMemoryMap();
 }
 
 void RAM64K::WriteIO(unsigned short address, unsigned char value)
@@ -90,15 +93,97 @@ void RAM64K::WriteIO(unsigned short address, unsigned char value)
     if (address >= 0xd000 && address < 0xe000)
     {
         // Hook before the value changes
-        _emulator.IOWrite(address, value);
-        _ioRam[address - 0xd000] = value;
+        unsigned offset = address - 0xd000;
+        if (_ioWriters[offset])
+            _ioWriters[offset]->IOWrite(address, value);
+        _ioRam[offset] = value;
     }
     else
-        _ram[address] = value;
+        WriteRAM(address, value);
 }
 
 void RAM64K::Write16(unsigned short address, unsigned short value)
 {
     Write(address, (unsigned char)(value & 0xFF));
     Write(++address, (unsigned char)(value >> 8));
+}
+
+bool RAM64K::IsStableRead(unsigned short address) const
+{
+    // Checked regardless of banking, as RAM reads are always stable
+    if (address < 0xd000 || address >= 0xe000)
+        return true;
+
+    IODevice* device = _ioReaders[address - 0xd000];
+    return !device || device->IOReadIsStable(address);
+}
+
+void RAM64K::RegisterIORead(unsigned short start, unsigned short end, IODevice* device)
+{
+    for (unsigned i = start; i <= end; ++i)
+        _ioReaders[i - 0xd000] = device;
+}
+
+void RAM64K::RegisterIOWrite(unsigned short start, unsigned short end, IODevice* device)
+{
+    for (unsigned i = start; i <= end; ++i)
+        _ioWriters[i - 0xd000] = device;
+}
+
+void RAM64K::MarkCode(unsigned short address)
+{
+    // Writes to pages containing code take the slow path to catch self-modifying code
+    SetWatch(address, WATCH_CODE, true);
+}
+
+void RAM64K::WatchData(unsigned short start, unsigned short end, bool enable)
+{
+    for (unsigned i = start; i <= end; ++i)
+        SetWatch((unsigned short)i, WATCH_DATA, enable);
+}
+
+void RAM64K::InvalidateCode(unsigned short address)
+{
+    // Bump the page's write generation so that cached code on the page gets redecoded.
+    // The byte stays unmarked until it is decoded again
+    unsigned char page = (unsigned char)(address >> 8);
+    ++_pageGenerations[page];
+    ++_codeWrites;
+    SetWatch(address, WATCH_CODE, false);
+}
+
+void RAM64K::SetWatch(unsigned short address, unsigned char watch, bool enable)
+{
+    unsigned char oldWatch = _watchedBytes[address];
+    unsigned char newWatch = (unsigned char)(enable ? (oldWatch | watch) : (oldWatch & ~watch));
+    if (newWatch == oldWatch)
+        return;
+
+    // Count the watched bytes of each page to know when its writes need the slow path
+    _watchedBytes[address] = newWatch;
+    unsigned char page = (unsigned char)(address >> 8);
+    if (!oldWatch && _pageWatchedBytes[page]++ == 0)
+        UpdatePage(page);
+    else if (!newWatch && --_pageWatchedBytes[page] == 0)
+        UpdatePage(page);
+}
+
+void RAM64K::UpdateMemoryMap()
+{
+    // Only the I/O area visibility depends on $01, so rebuild the I/O pages only when it changes
+    bool ioVisible = (_ram[0x01] & 0x3) != 0;
+    if (ioVisible == _ioVisible)
+        return;
+
+    _ioVisible = ioVisible;
+    for (unsigned i = 0xd0; i < 0xe0; ++i)
+        UpdatePage((unsigned char)i);
+}
+
+void RAM64K::UpdatePage(unsigned char page)
+{
+    bool io = _ioVisible && page >= 0xd0 && page < 0xe0;
+    unsigned char* memory = &_ram[page << 8];
+    _readPages[page] = io ? nullptr : memory;
+    _writePages[page] = (io || page == 0x00 || _pageWatchedBytes[page] > 0) ? nullptr : memory;
 }
\ No newline at end of file
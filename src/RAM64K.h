@@ -24,24 +24,88 @@
 
 #pragma once
 
-class Emulator;
+// Reasons for watching writes to a RAM byte
+const unsigned char WATCH_CODE = 0x1; // Decoded into the block cache
+const unsigned char WATCH_DATA = 0x2; // Contents cached elsewhere, for example by the VIC-II glyph cache
+
+// Interface for chips that hook reads or writes of their I/O registers. Writes are hooked before the value is stored
+class IODevice
+{
+public:
+    virtual ~IODevice() {}
+    virtual unsigned char IORead(unsigned short /*address*/) { return 0; }
+    virtual void IOWrite(unsigned short /*address*/, unsigned char /*value*/) {}
+    // Return whether reading the register has no side effects and returns the same value until the CPU run ends
+    virtual bool IOReadIsStable(unsigned short /*address*/) { return false; }
+};
 
 class RAM64K
 {
 public:
-    RAM64K(Emulator& emulator);
+    RAM64K();
+
+    unsigned char Read(unsigned short address)
+    {
+        const unsigned char* page = _readPages[address >> 8];
+        return page ? page[address & 0xff] : ReadIO(address);
+    }
+
+    void Write(unsigned short address, unsigned char value)
+    {
+        unsigned char* page = _writePages[address >> 8];
+        if (page)
+            page[address & 0xff] = value;
+        else
+            WriteUnmapped(address, value);
+    }
 
-    unsigned char Read(unsigned short address);
-    unsigned char ReadRAM(unsigned short address);
+    // Host pointers of a page, or null when accesses must go through Read / Write
+    const unsigned char* ReadPage(unsigned char page) const { return _readPages[page]; }
+    unsigned char* WritePage(unsigned char page) const { return _writePages[page]; }
+
+    unsigned char ReadRAM(unsigned short address) { return _ram[address]; }
     unsigned char ReadIO(unsigned short address, bool readInput = true);
     unsigned short Read16(unsigned short address);
-    void Write(unsigned short address, unsigned char value);
     void WriteRAM(unsigned short address, unsigned char value);
     void WriteIO(unsigned short address, unsigned char value);
     void Write16(unsigned short address, unsigned short value);
+    bool IsStableRead(unsigned short address) const;
+
+    void RegisterIORead(unsigned short start, unsigned short end, IODevice* device);
+    void RegisterIOWrite(unsigned short start, unsigned short end, IODevice* device);
+
+    void MarkCode(unsigned short address);
+    unsigned PageGeneration(unsigned char page) const { return _pageGenerations[page]; }
+    unsigned CodeWrites() const { return _codeWrites; }
+    // Count writes that change data in a range, so that caches of its contents can tell when it changes. Watched
+    // pages take the slow write path
+    void WatchData(unsigned short start, unsigned short end, bool enable);
+    unsigned DataGeneration(unsigned char page) const { return _dataGenerations[page]; }
 
 private:
-    Emulator& _emulator;
+    // Compiled code accesses RAM and the page tables directly
+    friend class JIT;
+
+    void WriteUnmapped(unsigned short address, unsigned char value);
+    void InvalidateCode(unsigned short address);
+    void SetWatch(unsigned short address, unsigned char watch, bool enable);
+    void UpdateMemoryMap();
+    void UpdatePage(unsigned char page);
+
     unsigned char _ram[65536];
     unsigned char _ioRam[4096];
+    // Devices hooking each I/O address. Null means plain storage
+    IODevice* _ioReaders[4096];
+    IODevice* _ioWriters[4096];
+    unsigned char _watchedBytes[65536];
+    unsigned _pageGenerations[256];
+    unsigned _dataGenerations[256];
+    unsigned _codeWrites;
+    // Host pointers for each 256 byte page. Null means the access must go through the slow path:
+    // I/O pages when I/O is banked in, writes to page 0 (the $01 banking register) and writes to pages containing
+    // watched bytes
+    unsigned char* _readPages[256];
+    unsigned char* _writePages[256];
+    unsigned short _pageWatchedBytes[256];
+    bool _ioVisible;
 };
\ No newline at end of file
@@ -25,11 +25,9 @@
 // jsSID by Hermit (Mihaly Horvath) : a javascript SID emulator and player for the Web Audio API
 // (Year 2016) http://hermit.sidrip.com
 
-#include <math.h>
 #include <stdio.h>
 #include "SID.h"
 #include "VIC2.h"
-#include "RAM64K.h"
 
 #define min(a,b) ((a)<(b)?(a):(b))
 
@@ -39,7 +37,36 @@ unsigned char expTargetTable[] = { 1,30,30,30,30,30,16,16,16,16,16,16,16,16,8,8,
     2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2
 };
 
+// Filter cutoff for each $d416 value, 16.16 fixed point. Computed as pow(0.05 + 0.85 * (sin(($d416 / 255 - 0.5) * pi) * 0.5 + 0.5), 1.3),
+// which is slightly darker than jsSID
+const int cutoffTable[] = {
+    1334, 1335, 1338, 1344, 1352, 1362, 1374, 1389, 1406, 1425, 1447, 1471, 1497, 1526, 1557, 1590,
+    1626, 1665, 1706, 1749, 1795, 1844, 1896, 1950, 2006, 2066, 2128, 2193, 2261, 2332, 2406, 2482,
+    2562, 2645, 2730, 2819, 2911, 3005, 3103, 3205, 3309, 3416, 3527, 3641, 3759, 3879, 4003, 4131,
+    4261, 4395, 4533, 4674, 4818, 4966, 5117, 5271, 5429, 5591, 5756, 5924, 6096, 6272, 6451, 6633,
+    6819, 7009, 7202, 7398, 7598, 7801, 8008, 8218, 8432, 8649, 8870, 9094, 9321, 9552, 9786, 10024,
+    10264, 10508, 10756, 11006, 11260, 11517, 11777, 12041, 12307, 12577, 12850, 13125, 13404, 13686, 13970, 14258,
+    14548, 14841, 15137, 15436, 15737, 16041, 16348, 16657, 16969, 17283, 17600, 17919, 18240, 18564, 18890, 19218,
+    19548, 19880, 20215, 20551, 20889, 21229, 21571, 21915, 22261, 22608, 22956, 23306, 23658, 24011, 24365, 24721,
+    25078, 25435, 25795, 26155, 26516, 26877, 27240, 27604, 27968, 28333, 28698, 29064, 29430, 29797, 30164, 30531,
+    30898, 31265, 31633, 32000, 32367, 32734, 33101, 33467, 33833, 34198, 34563, 34927, 35291, 35653, 36015, 36376,
+    36736, 37095, 37453, 37809, 38165, 38519, 38871, 39222, 39572, 39919, 40266, 40610, 40952, 41293, 41632, 41968,
+    42303, 42635, 42965, 43293, 43618, 43941, 44261, 44579, 44894, 45206, 45516, 45822, 46126, 46427, 46725, 47019,
+    47311, 47599, 47884, 48166, 48444, 48718, 48990, 49257, 49521, 49782, 50038, 50291, 50540, 50785, 51026, 51263,
+    51496, 51725, 51949, 52170, 52386, 52598, 52805, 53009, 53207, 53402, 53591, 53776, 53957, 54133, 54304, 54471,
+    54633, 54790, 54942, 55089, 55232, 55369, 55502, 55630, 55752, 55870, 55982, 56090, 56192, 56290, 56382, 56469,
+    56551, 56627, 56699, 56765, 56826, 56881, 56932, 56977, 57017, 57051, 57081, 57105, 57123, 57137, 57145, 57147
+};
+
+// Filter resonance for each $d417 high nibble, 16.16 fixed point: 7 / nibble, but at most 1.75
+const int resonanceTable[] = { 114688, 114688, 114688, 114688, 114688, 91750, 76459, 65536, 57344, 50972, 45875, 41705, 38229, 35289, 32768, 30583 };
+
 SIDChannel::SIDChannel() :
+    frequency(0),
+    ad(0),
+    sr(0),
+    pulse(0),
+    waveform(0),
     state(Release),
     noiseGenerator(0x7ffff8),
     adsrCounter(0),
@@ -48,7 +75,7 @@ SIDChannel::SIDChannel() :
 {
 }
 
-void SIDChannel::Clock(int cycles)
+void SIDChannel::UpdateGate()
 {
     if ((waveform & 0x1) != 0)
     {
@@ -57,7 +84,10 @@ void SIDChannel::Clock(int cycles)
     }
     else
         state = Release;
+}
 
+void SIDChannel::ClockEnvelope(int cycles)
+{
     int adsrCycles = cycles;
 
     while (adsrCycles > 0)
@@ -116,7 +146,10 @@ void SIDChannel::Clock(int cycles)
 
         adsrCycles -= adsrCyclesNow;
     }
+}
 
+void SIDChannel::ClockOscillator(int cycles)
+{
     // Testbit
     if ((waveform & 0x8) != 0)
     {
@@ -189,190 +222,454 @@ void SIDChannel::ResetAccumulator()
     accumulator = 0;
 }
 
-float SIDChannel::GetOutput()
+bool SIDChannel::IsFreeRunning() const
+{
+    // Noise steps and hard sync need the oscillator clocked in order with the other voices
+    return (waveform & 0x8) != 0 || ((waveform & 0x80) == 0 && (waveform & 0x2) == 0 && (syncTarget->waveform & 0x2) == 0);
+}
+
+void SIDChannel::ClockFreeRunning(const int* cycles, int count, unsigned* accumulators)
+{
+    // Testbit or frequency 0 keep the accumulator still
+    if ((waveform & 0x8) != 0)
+        accumulator = 0;
+    unsigned step = (waveform & 0x8) != 0 ? 0 : frequency;
+
+    unsigned position = accumulator;
+    for (int i = 0; i < count; ++i)
+    {
+        position += step * cycles[i];
+        accumulators[i] = position & 0xffffff;
+    }
+    accumulator = position & 0xffffff;
+}
+
+inline unsigned Triangle(unsigned accumulator, unsigned ringAccumulator)
+{
+    unsigned temp = accumulator ^ ringAccumulator;
+    return ((temp >= 0x800000 ? (accumulator ^ 0xffffff) : accumulator) >> 7) & 0xffff;
+}
+
+inline unsigned Sawtooth(unsigned accumulator)
 {
-    if (volumeLevel == 0)
-        return 0.f;
+    return accumulator >> 8;
+}
 
-    unsigned waveOutput = 0;
+inline unsigned Pulse(unsigned accumulator, unsigned pulseWidth)
+{
+    return (unsigned)((accumulator >> 12) >= pulseWidth ? 0xffff : 0x0);
+}
 
+inline unsigned Noise(unsigned noiseGenerator)
+{
+    return ((noiseGenerator & 0x100000) >> 5) + ((noiseGenerator & 0x40000) >> 4) + ((noiseGenerator & 0x4000) >> 1) + 
+           ((noiseGenerator & 0x800) << 1) + ((noiseGenerator & 0x200) << 2) + ((noiseGenerator & 0x20) << 5) + 
+           ((noiseGenerator & 0x04) << 7) + ((noiseGenerator & 0x01) << 8);
+}
+
+// Combine a waveform with pulse, approximating the combined waveforms
+inline unsigned CombinePulse(unsigned wave, unsigned square)
+{
+    unsigned waveOutput = ((square & wave & (wave >> 1)) & (wave << 1)) << 1;
+    return waveOutput > 0xffff ? 0xffff : waveOutput;
+}
+
+void SIDChannel::RenderWave(const unsigned* accumulators, const unsigned* ringAccumulators, const unsigned* noiseGenerators,
+    const unsigned char* volumeLevels, int* output, int count) const
+{
+    unsigned pulseWidth = pulse & 0xfff;
+    unsigned ringMask = (waveform & 0x4) != 0 ? 0xffffffff : 0;
+
+    // Output full scale is 1 << 24
     switch (waveform & 0xf0)
     {
         case 0x10:
-            waveOutput = Triangle();
+            for (int i = 0; i < count; ++i)
+                output[i] = ((int)Triangle(accumulators[i], ringAccumulators[i] & ringMask) - 0x8000) * volumeLevels[i];
             break;
         case 0x20:
-            waveOutput = Sawtooth();
+            for (int i = 0; i < count; ++i)
+                output[i] = ((int)Sawtooth(accumulators[i]) - 0x8000) * volumeLevels[i];
             break;
         case 0x40:
-            waveOutput = Pulse();
+            for (int i = 0; i < count; ++i)
+                output[i] = ((int)Pulse(accumulators[i], pulseWidth) - 0x8000) * volumeLevels[i];
             break;
         case 0x50:
+            for (int i = 0; i < count; ++i)
             {
-                unsigned triangle = Triangle();
-                unsigned square = Pulse();
-                waveOutput = ((square & triangle & (triangle >> 1)) & (triangle << 1)) << 1;
-                if (waveOutput > 0xffff)
-                    waveOutput = 0xffff;
+                unsigned wave = CombinePulse(Triangle(accumulators[i], ringAccumulators[i] & ringMask), Pulse(accumulators[i], pulseWidth));
+                output[i] = ((int)wave - 0x8000) * volumeLevels[i];
             }
             break;
         case 0x60:
+            for (int i = 0; i < count; ++i)
             {
-                unsigned saw = Sawtooth();
-                unsigned square = Pulse();
-                waveOutput = ((square & saw & (saw >> 1)) & (saw << 1)) << 1;
-                if (waveOutput > 0xffff)
-                    waveOutput = 0xffff;
+                unsigned wave = CombinePulse(Sawtooth(accumulators[i]), Pulse(accumulators[i], pulseWidth));
+                output[i] = ((int)wave - 0x8000) * volumeLevels[i];
             }
             break;
         case 0x70:
+            for (int i = 0; i < count; ++i)
             {
-                unsigned triSaw = Triangle() & Sawtooth();
-                unsigned square = Pulse();
-                waveOutput = ((square & triSaw & (triSaw >> 1)) & (triSaw << 1)) << 1;
-                if (waveOutput > 0xffff)
-                    waveOutput = 0xffff;
+                unsigned triSaw = Triangle(accumulators[i], ringAccumulators[i] & ringMask) & Sawtooth(accumulators[i]);
+                unsigned wave = CombinePulse(triSaw, Pulse(accumulators[i], pulseWidth));
+                output[i] = ((int)wave - 0x8000) * volumeLevels[i];
             }
             break;
         case 0x80:
-            waveOutput = Noise();
+            for (int i = 0; i < count; ++i)
+                output[i] = ((int)Noise(noiseGenerators[i]) - 0x8000) * volumeLevels[i];
+            break;
+        default:
+            for (int i = 0; i < count; ++i)
+                output[i] = -0x8000 * volumeLevels[i];
             break;
     }
+}
+
+SID::SID() :
+    _renderedCycle(0),
+    _threaded(false),
+    _readableSamples(0),
+    _outputFill(0),
+    _cycleAccumulator(0),
+    _prevBandPass(0),
+    _prevLowPass(0)
+#ifdef THREADS_SUPPORTED
+    ,
+    _renderFrameCycles(0),
+    _audioThreadRunning(false),
+    _audioPending(false),
+    _audioThreadQuit(false)
+#endif
+{
+    _channels[0].syncTarget = &_channels[1];
+    _channels[1].syncTarget = &_channels[2];
+    _channels[2].syncTarget = &_channels[0];
+    _channels[0].syncSource = &_channels[2];
+    _channels[1].syncSource = &_channels[0];
+    _channels[2].syncSource = &_channels[1];
 
-    return ((int)waveOutput - 0x8000) * volumeLevel / 16777216.f;
+    for (int i = 0; i < NUM_SID_REGISTERS; ++i)
+        _registers[i] = 0;
 }
 
-unsigned SIDChannel::Triangle()
+SID::~SID()
 {
-    unsigned temp = accumulator ^ ((waveform & 0x4) != 0 ? syncSource->accumulator : 0);
-    return ((temp >= 0x800000 ? (accumulator ^ 0xffffff) : accumulator) >> 7) & 0xffff;
+#ifdef THREADS_SUPPORTED
+    if (_audioThreadRunning)
+    {
+        WaitAudioThread();
+        _audioThreadQuit = true;
+        sem_post(&_audioStart);
+        pthread_join(_audioThread, nullptr);
+        sem_destroy(&_audioStart);
+        sem_destroy(&_audioDone);
+    }
+#endif
 }
 
-unsigned SIDChannel::Sawtooth()
+void SID::SetThreaded(bool enable)
 {
-    return accumulator >> 8;
+#ifdef THREADS_SUPPORTED
+    // Let a frame in flight finish before the synthesis state is used from this thread again
+    WaitAudioThread();
+
+    if (enable && !_audioThreadRunning)
+    {
+        sem_init(&_audioStart, 0, 0);
+        sem_init(&_audioDone, 0, 0);
+        _audioThreadRunning = pthread_create(&_audioThread, nullptr, AudioThread, this) == 0;
+        if (!_audioThreadRunning)
+        {
+            sem_destroy(&_audioStart);
+            sem_destroy(&_audioDone);
+            enable = false;
+        }
+    }
+#else
+    enable = false;
+#endif
+
+    _threaded = enable;
 }
 
-unsigned SIDChannel::Pulse()
+void SID::Write(int cycle, unsigned char reg, unsigned char value)
 {
-    return (unsigned)((accumulator >> 12) >= (pulse & 0xfff) ? 0xffff : 0x0);
+    // Audio is rendered later by replaying the writes at their cycles
+    SIDWrite write;
+    write.cycle = cycle;
+    write.reg = reg;
+    write.value = value;
+    _writes.push_back(write);
 }
 
-unsigned SIDChannel::Noise()
+void SID::EndFrame(int frameCycles)
 {
-    return ((noiseGenerator & 0x100000) >> 5) + ((noiseGenerator & 0x40000) >> 4) + ((noiseGenerator & 0x4000) >> 1) + 
-           ((noiseGenerator & 0x800) << 1) + ((noiseGenerator & 0x200) << 2) + ((noiseGenerator & 0x20) << 5) + 
-           ((noiseGenerator & 0x04) << 7) + ((noiseGenerator & 0x01) << 8);
+#ifdef THREADS_SUPPORTED
+    if (_threaded)
+    {
+        // Hand the frame's writes to the audio thread. Writes it left over past the previous frame end were rebased to
+        // this frame, and come before this frame's writes
+        WaitAudioThread();
+        _readableSamples = _output.Size();
+        _outputFill = _readableSamples;
+        _renderWrites.insert(_renderWrites.end(), _writes.begin(), _writes.end());
+        _writes.clear();
+        _renderFrameCycles = frameCycles;
+        _audioPending = true;
+        sem_post(&_audioStart);
+        return;
+    }
+#endif
+
+    _outputFill = _output.Size();
+    RenderFrame(_writes, frameCycles);
+    _readableSamples = _output.Size();
 }
 
-SID::SID(RAM64K& ram) :
-    _ram(ram),
-    _cycleAccumulator(0.f),
-    _prevBandPass(0.f),
-    _prevLowPass(0.f)
+unsigned SID::ReadSamples(short* samples, unsigned count)
 {
-    _channels[0].syncTarget = &_channels[1];
-    _channels[1].syncTarget = &_channels[2];
-    _channels[2].syncTarget = &_channels[0];
-    _channels[0].syncSource = &_channels[2];
-    _channels[1].syncSource = &_channels[0];
-    _channels[2].syncSource = &_channels[1];
+    if (count > _readableSamples)
+        count = _readableSamples;
+    count = _output.Read(samples, count);
+    _readableSamples -= count;
+    return count;
+}
+
+void SID::ReplayWrites(std::vector<SIDWrite>& writes, int cycle)
+{
+    // Render up to each logged write with the old register values, then apply it
+    unsigned numWrites = 0;
+    while (numWrites < writes.size() && writes[numWrites].cycle <= cycle)
+    {
+        const SIDWrite& write = writes[numWrites++];
+        RenderCycles(write.cycle - _renderedCycle);
+        _renderedCycle = write.cycle;
+        ApplyWrite(write.reg, write.value);
+    }
+    writes.erase(writes.begin(), writes.begin() + numWrites);
+
+    if (_renderedCycle < cycle)
+    {
+        RenderCycles(cycle - _renderedCycle);
+        _renderedCycle = cycle;
+    }
+}
+
+void SID::RenderFrame(std::vector<SIDWrite>& writes, int frameCycles)
+{
+    ReplayWrites(writes, frameCycles);
+    CommitSamples();
 
-    _cyclesPerSample = (63.f*312.f*50.f) / 44100.f;
-    _cutoffRatio = -2.f * 3.14f * (18000. / 256.f) / 44100.f; // 6581 filter
+    // Cycles start from zero on the next frame
+    _renderedCycle = 0;
+    for (unsigned i = 0; i < writes.size(); ++i)
+        writes[i].cycle -= frameCycles;
 }
 
-void SID::BufferSamples(int cpuCycles)
+void SID::CommitSamples()
 {
-    if (cpuCycles == 0)
-        return;
+    // The buffer fill adjustment keeps the ring from filling up, so samples are not dropped in practice
+    if (_samples.size())
+        _output.Write(&_samples[0], _samples.size());
+    _samples.clear();
+}
 
-    // Adjust amount of cycles to render based on buffer fill
-    float multiplier = 1.f + (2048 - (int)samples.size()) / 8192.f;
-    // Let multiplier remain at 1 when we're executing the playroutine, to make sure ADSR behavior is accurate
-    if (cpuCycles <= CYCLES_PER_LINE*2)
-        multiplier = 1.f;
-    cpuCycles = (int)(multiplier * cpuCycles);
+#ifdef THREADS_SUPPORTED
+void SID::WaitAudioThread()
+{
+    if (_audioPending)
+    {
+        sem_wait(&_audioDone);
+        _audioPending = false;
+    }
+}
 
-    for (int i = 0; i < 3; ++i)
+void* SID::AudioThread(void* data)
+{
+    SID* sid = (SID*)data;
+
+    for (;;)
+    {
+        sem_wait(&sid->_audioStart);
+        if (sid->_audioThreadQuit)
+            break;
+
+        sid->RenderFrame(sid->_renderWrites, sid->_renderFrameCycles);
+
+        sem_post(&sid->_audioDone);
+    }
+
+    return nullptr;
+}
+#endif
+
+void SID::ApplyWrite(unsigned char reg, unsigned char value)
+{
+    _registers[reg] = value;
+    if (reg >= 21)
+        return;
+
+    SIDChannel& channel = _channels[reg / 7];
+    switch (reg % 7)
     {
-        unsigned short ioBase = (unsigned short)(0xd400 + i * 7);
-        _channels[i].frequency = (unsigned short)(_ram.ReadIO(ioBase) | (_ram.ReadIO((unsigned short)(ioBase + 1)) << 8));
-        _channels[i].pulse = (unsigned short)(_ram.ReadIO((unsigned short)(ioBase + 2)) | (_ram.ReadIO((unsigned short)(ioBase + 3)) << 8));
-        _channels[i].waveform = _ram.ReadIO((unsigned short)(ioBase + 4));
-        _channels[i].ad = _ram.ReadIO((unsigned short)(ioBase + 5));
-        _channels[i].sr = _ram.ReadIO((unsigned short)(ioBase + 6));
+        case 0:
+            channel.frequency = (unsigned short)((channel.frequency & 0xff00) | value);
+            break;
+        case 1:
+            channel.frequency = (unsigned short)((channel.frequency & 0xff) | (value << 8));
+            break;
+        case 2:
+            channel.pulse = (unsigned short)((channel.pulse & 0xff00) | value);
+            break;
+        case 3:
+            channel.pulse = (unsigned short)((channel.pulse & 0xff) | (value << 8));
+            break;
+        case 4:
+            channel.waveform = value;
+            channel.UpdateGate();
+            break;
+        case 5:
+            channel.ad = value;
+            break;
+        case 6:
+            channel.sr = value;
+            break;
     }
+}
 
-    float masterVol = (_ram.ReadIO(0xd418) & 0xf) / 22.5f;
-    unsigned char filterSelect = (unsigned char)(_ram.ReadIO(0xd418) & 0x70);
-    unsigned char filterCtrl = _ram.ReadIO(0xd417);
+void SID::RenderCycles(int cpuCycles)
+{
+    if (cpuCycles <= 0)
+        return;
 
-    // Filter cutoff & resonance
-    // Adjusted to be slightly darker than jsSID
-    float cutoff = 0.05f + 0.85f * (sinf((_ram.ReadIO(0xd416) / 255.0f - 0.5f) * M_PI) * 0.5f + 0.5f);
-    cutoff = powf(cutoff, 1.3f);
-    float resonance = (_ram.ReadIO(0xd417) > 0x3f) ? 7.0f / (_ram.ReadIO(0xd417) >> 4) : 1.75f;
+    // Adjust amount of cycles to render based on buffer fill
+    // Let multiplier remain at 1 when we're executing the playroutine, to make sure ADSR behavior is accurate
+    if (cpuCycles > CYCLES_PER_LINE*2)
+        cpuCycles = cpuCycles * (8192 + 2048 - (int)(_outputFill + _samples.size())) / 8192;
+
+    bool freeRunning[3];
+    for (int i = 0; i < 3; ++i)
+        freeRunning[i] = _channels[i].IsFreeRunning();
 
     while (cpuCycles > 0)
     {
-        int cyclesToRun = min(cpuCycles, (int)ceilf(_cyclesPerSample - _cycleAccumulator));
+        // Split the next block into runs of cycles, each ending at a sample or at the end of the cycles to render
+        int numRuns = 0;
+        int numSamples = 0;
+        while (cpuCycles > 0 && numSamples < SID_BLOCK_SAMPLES)
+        {
+            int cyclesToRun = min(cpuCycles, (SAMPLE_LENGTH - _cycleAccumulator + CYCLE_FRACTIONS - 1) / CYCLE_FRACTIONS);
+            _runCycles[numRuns++] = cyclesToRun;
+            _cycleAccumulator += cyclesToRun * CYCLE_FRACTIONS;
+            if (_cycleAccumulator >= SAMPLE_LENGTH)
+            {
+                _cycleAccumulator -= SAMPLE_LENGTH;
+                ++numSamples;
+            }
+            cpuCycles -= cyclesToRun;
+        }
 
-        for (int j = 0; j < 3; ++j)
-            _channels[j].Clock(cyclesToRun);
-        for (int j = 0; j < 3; ++j)
+        // Envelopes and oscillators are stored after each run, voice by voice
+        for (int i = 0; i < 3; ++i)
         {
-            if (_channels[j].doSync && (_channels[j].syncTarget->waveform & 0x2) != 0)
-                _channels[j].syncTarget->ResetAccumulator();
+            SIDChannel& channel = _channels[i];
+            for (int j = 0; j < numRuns; ++j)
+            {
+                channel.ClockEnvelope(_runCycles[j]);
+                _volumeLevels[i][j] = channel.volumeLevel;
+            }
+            if (freeRunning[i])
+                channel.ClockFreeRunning(_runCycles, numRuns, _accumulators[i]);
         }
-    
-        _cycleAccumulator += cyclesToRun;
 
-        if (_cycleAccumulator >= _cyclesPerSample)
+        // Voices with noise or hard sync are clocked run by run, in the same order as before blocks
+        if (!freeRunning[0] || !freeRunning[1] || !freeRunning[2])
+        {
+            for (int j = 0; j < numRuns; ++j)
+            {
+                for (int i = 0; i < 3; ++i)
+                {
+                    if (!freeRunning[i])
+                        _channels[i].ClockOscillator(_runCycles[j]);
+                }
+                for (int i = 0; i < 3; ++i)
+                {
+                    if (_channels[i].doSync && (_channels[i].syncTarget->waveform & 0x2) != 0)
+                        _channels[i].syncTarget->ResetAccumulator();
+                }
+                for (int i = 0; i < 3; ++i)
+                {
+                    if (!freeRunning[i])
+                        _accumulators[i][j] = _channels[i].accumulator;
+                    _noiseGenerators[i][j] = _channels[i].noiseGenerator;
+                }
+            }
+        }
+        else
         {
-            _cycleAccumulator -= _cyclesPerSample;
+            for (int i = 0; i < 3; ++i)
+            {
+                for (int j = 0; j < numRuns; ++j)
+                    _noiseGenerators[i][j] = _channels[i].noiseGenerator;
+            }
+        }
 
-            float output = 0.f;
-            float filterInput = 0.f;
+        // The last run may end without a sample, otherwise all runs are samples
+        for (int i = 0; i < 3; ++i)
+            _channels[i].RenderWave(_accumulators[i], _accumulators[_channels[i].syncSource - _channels], _noiseGenerators[i], _volumeLevels[i], _outputs[i], numSamples);
 
-            if ((filterCtrl & 1) == 0)
-                output += _channels[0].GetOutput();
-            else
-                filterInput += _channels[0].GetOutput();
+        MixSamples(numSamples);
+    }
+}
 
-            if ((filterCtrl & 2) == 0)
-                output += _channels[1].GetOutput();
-            else
-                filterInput += _channels[1].GetOutput();
+void SID::MixSamples(int numSamples)
+{
+    // Master volume divides by 22.5, so that full volume is 2 / 3
+    int masterVol = (_registers[0x18] & 0xf) * 2;
+    unsigned char filterSelect = (unsigned char)(_registers[0x18] & 0x70);
+    unsigned char filterCtrl = _registers[0x17];
+
+    // Filter cutoff & resonance
+    long long cutoff = cutoffTable[_registers[0x16]];
+    long long resonance = resonanceTable[_registers[0x17] >> 4];
+
+    for (int i = 0; i < numSamples; ++i)
+    {
+        // Fixed point with full scale 1 << 24
+        long long output = 0;
+        long long filterInput = 0;
 
-            if ((filterCtrl & 4) == 0)
-                output += _channels[2].GetOutput();
+        for (int j = 0; j < 3; ++j)
+        {
+            if ((filterCtrl & (1 << j)) == 0)
+                output += _outputs[j][i];
             else
-                filterInput += _channels[2].GetOutput();
-
-            // Highpass
-            float temp = filterInput + _prevBandPass * resonance + _prevLowPass;
-            if ((filterSelect & 0x40) != 0)
-                output -= temp;
-            // Bandpass
-            temp = _prevBandPass - temp * cutoff;
-            _prevBandPass = temp;
-            if ((filterSelect & 0x20) != 0)
-                output -= temp;
-            // Lowpass
-            temp = _prevLowPass + temp * cutoff;
-            _prevLowPass = temp;
-            if ((filterSelect & 0x10) != 0)
-                output += temp;
-
-            output *= masterVol;
-            if (output < -1.f)
-                output = -1.f;
-            if (output > 1.f)
-                output = 1.f;
-            samples.push_back((short)(output * 32767));
+                filterInput += _outputs[j][i];
         }
-        
-        cpuCycles -= cyclesToRun;
+
+        // Highpass
+        long long temp = filterInput + ((_prevBandPass * resonance) >> 16) + _prevLowPass;
+        if ((filterSelect & 0x40) != 0)
+            output -= temp;
+        // Bandpass
+        temp = _prevBandPass - ((temp * cutoff) >> 16);
+        _prevBandPass = temp;
+        if ((filterSelect & 0x20) != 0)
+            output -= temp;
+        // Lowpass
+        temp = _prevLowPass + ((temp * cutoff) >> 16);
+        _prevLowPass = temp;
+        if ((filterSelect & 0x10) != 0)
+            output += temp;
+
+        output = output * masterVol / 45;
+        if (output < -(1 << 24))
+            output = -(1 << 24);
+        if (output > (1 << 24))
+            output = 1 << 24;
+        _samples.push_back((short)(output * 32767 / (1 << 24)));
     }
-}
\ No newline at end of file
+}
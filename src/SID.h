@@ -28,8 +28,16 @@
 #pragma once
 
 #include <vector>
+#include "SampleRing.h"
+#include "Thread.h"
 
-class RAM64K;
+// Synthesis is in integer arithmetic only, so that the output is identical on all compilers and platforms. Sample
+// timing is counted in sevenths of a cycle, as there are 63 * 312 * 50 / 44100 = 156 / 7 cycles per sample
+const int CYCLE_FRACTIONS = 7;
+const int SAMPLE_LENGTH = 156; // In cycle fractions
+// Samples are rendered in blocks, one voice at a time
+const int SID_BLOCK_SAMPLES = 256;
+const int NUM_SID_REGISTERS = 0x19;
 
 enum ADSRState
 {
@@ -42,13 +50,14 @@ class SIDChannel
 {
 public:
     SIDChannel();
-    void Clock(int cycles);
+    void UpdateGate();
+    void ClockEnvelope(int cycles);
+    void ClockOscillator(int cycles);
     void ResetAccumulator();
-    float GetOutput();
-    unsigned Triangle();
-    unsigned Sawtooth();
-    unsigned Pulse();
-    unsigned Noise();
+    bool IsFreeRunning() const;
+    void ClockFreeRunning(const int* cycles, int count, unsigned* accumulators);
+    void RenderWave(const unsigned* accumulators, const unsigned* ringAccumulators, const unsigned* noiseGenerators,
+        const unsigned char* volumeLevels, int* output, int count) const;
 
     SIDChannel* syncTarget;
     SIDChannel* syncSource;
@@ -68,21 +77,75 @@ public:
     unsigned char volumeLevel;
 };
 
+// Register write, stamped with the CPU cycle within the frame
+struct SIDWrite
+{
+    int cycle;
+    unsigned char reg;
+    unsigned char value;
+};
+
+// Renders audio from the logged register writes, either on the calling thread or on an audio thread. Samples are
+// read from a lock-free ring by the audio backend
 class SID
 {
 public:
-    SID(RAM64K& ram);
-    void BufferSamples(int cpuCycles);
-    
-    std::vector<short> samples;
+    SID();
+    ~SID();
+    void SetThreaded(bool enable);
+    bool IsThreaded() const { return _threaded; }
+    void Write(int cycle, unsigned char reg, unsigned char value);
+    void EndFrame(int frameCycles);
+    unsigned NumSamples() const { return _readableSamples; }
+    unsigned ReadSamples(short* samples, unsigned count);
+    SampleRing* Output() { return &_output; }
 
 private:
-    RAM64K& _ram;
+    void ReplayWrites(std::vector<SIDWrite>& writes, int cycle);
+    void RenderFrame(std::vector<SIDWrite>& writes, int frameCycles);
+    void CommitSamples();
+    void ApplyWrite(unsigned char reg, unsigned char value);
+    void RenderCycles(int cpuCycles);
+    void MixSamples(int numSamples);
+#ifdef THREADS_SUPPORTED
+    void WaitAudioThread();
+    static void* AudioThread(void* data);
+#endif
+
     SIDChannel _channels[3];
+    unsigned char _registers[NUM_SID_REGISTERS];
+    std::vector<SIDWrite> _writes;
+    int _renderedCycle;
+    bool _threaded;
+
+    // Samples rendered but not yet committed to the output ring
+    std::vector<short> _samples;
+    SampleRing _output;
+    // Samples in the ring when the last frame was rendered or handed to the audio thread, minus those read since. Reads
+    // and the buffer fill adjustment go by these counts instead of the live ring size, so that the output does not
+    // depend on the timing of the audio thread
+    unsigned _readableSamples;
+    unsigned _outputFill;
+
+    // Per-voice state after each run of cycles in a block. A block can end with a run that does not complete a sample
+    int _runCycles[SID_BLOCK_SAMPLES + 1];
+    unsigned char _volumeLevels[3][SID_BLOCK_SAMPLES + 1];
+    unsigned _accumulators[3][SID_BLOCK_SAMPLES + 1];
+    unsigned _noiseGenerators[3][SID_BLOCK_SAMPLES + 1];
+    int _outputs[3][SID_BLOCK_SAMPLES];
+
+    int _cycleAccumulator;
+    long long _prevBandPass;
+    long long _prevLowPass;
 
-    float _cutoffRatio;
-    float _cyclesPerSample;
-    float _cycleAccumulator;
-    float _prevBandPass;
-    float _prevLowPass;
+#ifdef THREADS_SUPPORTED
+    pthread_t _audioThread;
+    sem_t _audioStart;
+    sem_t _audioDone;
+    std::vector<SIDWrite> _renderWrites;
+    int _renderFrameCycles;
+    bool _audioThreadRunning;
+    bool _audioPending;
+    bool _audioThreadQuit;
+#endif
 };
\ No newline at end of file
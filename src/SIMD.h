@@ -0,0 +1,72 @@
+// MIT License
+// 
+// Copyright (c) 2018-2026 Lasse Oorni
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+// Minimal 16 x 8-bit vector operations for byte table lookups, using SSSE3, AArch64 NEON or WebAssembly SIMD when
+// available. SIMD_BYTE_LOOKUP is defined if they are
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+
+#define SIMD_BYTE_LOOKUP 1
+
+typedef __m128i Vec128;
+
+inline Vec128 Vec128Load(const void* src) { return _mm_loadu_si128((const __m128i*)src); }
+inline void Vec128Store(void* dest, Vec128 value) { _mm_storeu_si128((__m128i*)dest, value); }
+inline Vec128 Vec128Lookup(Vec128 table, Vec128 indices) { return _mm_shuffle_epi8(table, indices); }
+inline Vec128 Vec128ZipBytesLow(Vec128 a, Vec128 b) { return _mm_unpacklo_epi8(a, b); }
+inline Vec128 Vec128ZipBytesHigh(Vec128 a, Vec128 b) { return _mm_unpackhi_epi8(a, b); }
+inline Vec128 Vec128ZipShortsLow(Vec128 a, Vec128 b) { return _mm_unpacklo_epi16(a, b); }
+inline Vec128 Vec128ZipShortsHigh(Vec128 a, Vec128 b) { return _mm_unpackhi_epi16(a, b); }
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+
+#define SIMD_BYTE_LOOKUP 1
+
+typedef uint8x16_t Vec128;
+
+inline Vec128 Vec128Load(const void* src) { return vld1q_u8((const unsigned char*)src); }
+inline void Vec128Store(void* dest, Vec128 value) { vst1q_u8((unsigned char*)dest, value); }
+inline Vec128 Vec128Lookup(Vec128 table, Vec128 indices) { return vqtbl1q_u8(table, indices); }
+inline Vec128 Vec128ZipBytesLow(Vec128 a, Vec128 b) { return vzip1q_u8(a, b); }
+inline Vec128 Vec128ZipBytesHigh(Vec128 a, Vec128 b) { return vzip2q_u8(a, b); }
+inline Vec128 Vec128ZipShortsLow(Vec128 a, Vec128 b) { return vreinterpretq_u8_u16(vzip1q_u16(vreinterpretq_u16_u8(a), vreinterpretq_u16_u8(b))); }
+inline Vec128 Vec128ZipShortsHigh(Vec128 a, Vec128 b) { return vreinterpretq_u8_u16(vzip2q_u16(vreinterpretq_u16_u8(a), vreinterpretq_u16_u8(b))); }
+
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+
+#define SIMD_BYTE_LOOKUP 1
+
+typedef v128_t Vec128;
+
+inline Vec128 Vec128Load(const void* src) { return wasm_v128_load(src); }
+inline void Vec128Store(void* dest, Vec128 value) { wasm_v128_store(dest, value); }
+inline Vec128 Vec128Lookup(Vec128 table, Vec128 indices) { return wasm_i8x16_swizzle(table, indices); }
+inline Vec128 Vec128ZipBytesLow(Vec128 a, Vec128 b) { return wasm_i8x16_shuffle(a, b, 0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23); }
+inline Vec128 Vec128ZipBytesHigh(Vec128 a, Vec128 b) { return wasm_i8x16_shuffle(a, b, 8, 24, 9, 25, 10, 26, 11, 27, 12, 28, 13, 29, 14, 30, 15, 31); }
+inline Vec128 Vec128ZipShortsLow(Vec128 a, Vec128 b) { return wasm_i16x8_shuffle(a, b, 0, 8, 1, 9, 2, 10, 3, 11); }
+inline Vec128 Vec128ZipShortsHigh(Vec128 a, Vec128 b) { return wasm_i16x8_shuffle(a, b, 4, 12, 5, 13, 6, 14, 7, 15); }
+
+#endif
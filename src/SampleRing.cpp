@@ -0,0 +1,58 @@
+// MIT License
+// 
+// Copyright (c) 2018-2026 Lasse Oorni
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "SampleRing.h"
+
+SampleRing::SampleRing() :
+    _readPos(0),
+    _writePos(0)
+{
+}
+
+unsigned SampleRing::Write(const short* samples, unsigned count)
+{
+    // Only the producer moves the write position, and the samples are stored before it is published
+    unsigned writePos = _writePos.load(std::memory_order_relaxed);
+    unsigned space = SAMPLE_RING_SIZE - (writePos - _readPos.load(std::memory_order_acquire));
+    if (count > space)
+        count = space;
+
+    for (unsigned i = 0; i < count; ++i)
+        _samples[(writePos + i) & (SAMPLE_RING_SIZE - 1)] = samples[i];
+
+    _writePos.store(writePos + count, std::memory_order_release);
+    return count;
+}
+
+unsigned SampleRing::Read(short* samples, unsigned count)
+{
+    unsigned readPos = _readPos.load(std::memory_order_relaxed);
+    unsigned available = _writePos.load(std::memory_order_acquire) - readPos;
+    if (count > available)
+        count = available;
+
+    for (unsigned i = 0; i < count; ++i)
+        samples[i] = _samples[(readPos + i) & (SAMPLE_RING_SIZE - 1)];
+
+    _readPos.store(readPos + count, std::memory_order_release);
+    return count;
+}
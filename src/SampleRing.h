@@ -0,0 +1,44 @@
+// MIT License
+// 
+// Copyright (c) 2018-2026 Lasse Oorni
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <atomic>
+
+const unsigned SAMPLE_RING_SIZE = 16384; // Power of two
+
+// Lock-free ring of audio samples for one producer and one consumer thread. The read and write positions count
+// up freely and wrap around, so that the ring can be filled completely
+class SampleRing
+{
+public:
+    SampleRing();
+
+    unsigned Write(const short* samples, unsigned count);
+    unsigned Read(short* samples, unsigned count);
+    unsigned Size() const { return _writePos.load(std::memory_order_acquire) - _readPos.load(std::memory_order_acquire); }
+
+private:
+    short _samples[SAMPLE_RING_SIZE];
+    std::atomic<unsigned> _readPos;
+    std::atomic<unsigned> _writePos;
+};
@@ -0,0 +1,52 @@
+// MIT License
+// 
+// Copyright (c) 2018-2026 Lasse Oorni
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <emscripten.h>
+#include "SaveData.h"
+
+void SaveData::Init()
+{
+    // Load old saves
+    EM_ASM(
+        FS.mkdir('/savedata');
+        FS.mount(IDBFS,{},'/savedata');
+        FS.syncfs(true, function(err) {
+            if (!err) {
+                Module.print('Savefiles initialized');
+            }
+        });
+    );
+}
+
+std::string SaveData::Directory()
+{
+    return "/savedata/";
+}
+
+void SaveData::Sync()
+{
+    // Begin sync to persistent file system
+    EM_ASM(
+        FS.syncfs(false, function(err) {
+        });
+    );
+}
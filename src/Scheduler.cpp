@@ -0,0 +1,81 @@
+// MIT License
+// 
+// Copyright (c) 2018-2026 Lasse Oorni
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "Scheduler.h"
+
+Scheduler::Scheduler() :
+    _nextCycle(NO_EVENT)
+{
+    for (int i = 0; i < NUM_EVENT_TYPES; ++i)
+        _eventCycles[i] = NO_EVENT;
+}
+
+void Scheduler::Schedule(EventType type, int cycle)
+{
+    _eventCycles[type] = cycle;
+    UpdateNextCycle();
+}
+
+void Scheduler::Cancel(EventType type)
+{
+    _eventCycles[type] = NO_EVENT;
+    UpdateNextCycle();
+}
+
+bool Scheduler::PopEvent(int cycle, EventType& type)
+{
+    if (_nextCycle > cycle)
+        return false;
+
+    for (int i = 0; i < NUM_EVENT_TYPES; ++i)
+    {
+        if (_eventCycles[i] == _nextCycle)
+        {
+            type = (EventType)i;
+            Cancel(type);
+            return true;
+        }
+    }
+    return false;
+}
+
+void Scheduler::Rebase(int cycles)
+{
+    // Called when the CPU cycle count is reset at the end of a frame
+    for (int i = 0; i < NUM_EVENT_TYPES; ++i)
+    {
+        if (_eventCycles[i] != NO_EVENT)
+            _eventCycles[i] -= cycles;
+    }
+    UpdateNextCycle();
+}
+
+void Scheduler::UpdateNextCycle()
+{
+    // With only a few event types a linear scan beats a heap
+    _nextCycle = NO_EVENT;
+    for (int i = 0; i < NUM_EVENT_TYPES; ++i)
+    {
+        if (_eventCycles[i] < _nextCycle)
+            _nextCycle = _eventCycles[i];
+    }
+}
@@ -0,0 +1,53 @@
+// MIT License
+// 
+// Copyright (c) 2018-2026 Lasse Oorni
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+enum EventType
+{
+    EventLineEnd = 0,
+    EventRasterCompare,
+    EventTimerA,
+    NUM_EVENT_TYPES
+};
+
+const int NO_EVENT = 0x7fffffff;
+
+// Timed emulation events in CPU cycles. Each event type has one slot, so scheduling an event again moves it.
+// Events due on the same cycle are returned in event type order
+class Scheduler
+{
+public:
+    Scheduler();
+
+    void Schedule(EventType type, int cycle);
+    void Cancel(EventType type);
+    bool PopEvent(int cycle, EventType& type);
+    void Rebase(int cycles);
+    int NextEventCycle() const { return _nextCycle; }
+
+private:
+    void UpdateNextCycle();
+
+    int _eventCycles[NUM_EVENT_TYPES];
+    int _nextCycle;
+};
@@ -26,12 +26,15 @@
 #include <emscripten.h>
 #include <emscripten/html5.h>
 #include "Screen.h"
+#include "Palette.h"
 
 EMSCRIPTEN_WEBGL_CONTEXT_HANDLE glContext;
 GLuint quadBuffer;
 GLuint matPos;
 GLuint screenTexture;
+GLuint paletteTexture;
 GLuint quadProgram;
+unsigned bytesUploaded = 0;
 
 GLuint CompileShader(GLenum shaderType, const char* src)
 {
@@ -94,29 +97,63 @@ void Screen::Init()
     static const char fragmentShader[] =
         "precision lowp float;"
         "uniform sampler2D tex;"
+        "uniform sampler2D palette;"
         "varying vec2 uv;"
         "void main(){"
+            "float index = texture2D(tex,uv).r * 255.0;"
             "float scanLine = clamp(sin((uv.y * 200.0 - 0.25) * 2.0 * 3.14) * 0.5 + 0.66, 0.1, 1.0);"
-            "gl_FragColor = scanLine * texture2D(tex,uv);"
+            "gl_FragColor = scanLine * texture2D(palette,vec2((index + 0.5) / 16.0, 0.5));"
         "}";
     GLuint fs = CompileShader(GL_FRAGMENT_SHADER, fragmentShader);
 
     quadProgram = CreateProgram(vs, fs);
     matPos = glGetUniformLocation(quadProgram, "mat");
 
+    glUniform1i(glGetUniformLocation(quadProgram, "tex"), 0);
+    glUniform1i(glGetUniformLocation(quadProgram, "palette"), 1);
+
+    // Screen is uploaded as one byte per pixel palette indices, the palette is looked up in the shader
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    glActiveTexture(GL_TEXTURE1);
+    paletteTexture = CreateTexture();
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, NUM_COLORS, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, Palette::colors);
+
+    glActiveTexture(GL_TEXTURE0);
     screenTexture = CreateTexture();
-    unsigned initialScreenData[320 * 200];
+    unsigned char initialScreenData[320 * 200];
     memset(initialScreenData, 0, sizeof initialScreenData);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 320, 200, 0, GL_RGBA, GL_UNSIGNED_BYTE, &initialScreenData);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, 320, 200, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, &initialScreenData);
 
     const float quadBufferData[] = { 0, 0, 1, 0, 0, 1, 1, 1 };
     quadBuffer = CreateVertexBuffer(8, quadBufferData);
 }
 
-void Screen::Redraw(unsigned* screenData)
+void Screen::Redraw(unsigned char* screenData, const bool* dirtyLines)
 {
     glBindTexture(GL_TEXTURE_2D, screenTexture);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 320, 200, GL_RGBA, GL_UNSIGNED_BYTE, screenData);
+
+    // Upload each run of changed rows with one call. Texture rows are bottom-up
+    bytesUploaded = 0;
+    int row = 0;
+    while (row < 200)
+    {
+        if (!dirtyLines[199 - row])
+        {
+            ++row;
+            continue;
+        }
+
+        int startRow = row;
+        while (row < 200 && dirtyLines[199 - row])
+            ++row;
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, startRow, 320, row - startRow, GL_LUMINANCE, GL_UNSIGNED_BYTE, &screenData[startRow * 320]);
+        bytesUploaded += (row - startRow) * 320;
+    }
+
+    // Nothing changed, the canvas keeps showing the previous frame
+    if (bytesUploaded == 0)
+        return;
 
     float x = 0.0f;
     float y = 0.0f;
@@ -131,5 +168,9 @@ void Screen::Redraw(unsigned* screenData)
     glUseProgram(quadProgram);
 
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
 
+unsigned Screen::BytesUploaded()
+{
+    return bytesUploaded;
 }
@@ -26,5 +26,8 @@ class Screen
 {
 public:
     static void Init();
-    static void Redraw(unsigned* data);
+    // Redraw from palette indices, stored bottom-up. Only lines flagged in dirtyLines (0-199 from the top) are uploaded
+    static void Redraw(unsigned char* data, const bool* dirtyLines);
+    // Bytes of screen data uploaded by the last redraw
+    static unsigned BytesUploaded();
 };
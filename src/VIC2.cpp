@@ -21,16 +21,280 @@
 // SOFTWARE.
 
 #include <stdlib.h>
+#include <string.h>
 #include "VIC2.h"
 #include "RAM64K.h"
 
 unsigned char VIC2::bitValues[] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80 };
-unsigned VIC2::_palette[] = { 0xff000000, 0xffffffff, 0xff2b3768, 0xffb2a470, 0xff863d6f, 0xff438d58, 0xff792835, 0xff6fc7b8,
-                       0xff254f6f, 0xff003943, 0xff59679a, 0xff444444, 0xff6c6c6c, 0xff84d29a, 0xffb55e6c, 0xff959595 };
+
+// Byte masks for expanding 8 pixels at a time, in memory order
+static unsigned long long hiresMasks[256];
+static unsigned long long multicolorHighMasks[256];
+static unsigned long long multicolorLowMasks[256];
+// Sprite data bytes with each pixel or bit pair doubled, for X-expansion
+static unsigned short doubledBits[256];
+static unsigned short doubledPairs[256];
+
+static void InitExpandMasks()
+{
+    for (int i = 0; i < 256; ++i)
+    {
+        unsigned char hires[8];
+        unsigned char high[8];
+        unsigned char low[8];
+        for (int j = 0; j < 8; ++j)
+        {
+            hires[j] = (i & (0x80 >> j)) ? 0xff : 0x00;
+            high[j] = (i & (0x80 >> (j & 0x6))) ? 0xff : 0x00;
+            low[j] = (i & (0x40 >> (j & 0x6))) ? 0xff : 0x00;
+        }
+        memcpy(&hiresMasks[i], hires, 8);
+        memcpy(&multicolorHighMasks[i], high, 8);
+        memcpy(&multicolorLowMasks[i], low, 8);
+
+        doubledBits[i] = 0;
+        doubledPairs[i] = 0;
+        for (int j = 0; j < 8; ++j)
+        {
+            if (i & (1 << j))
+                doubledBits[i] |= (unsigned short)(3 << (j * 2));
+        }
+        for (int j = 0; j < 4; ++j)
+        {
+            int pair = (i >> (j * 2)) & 0x3;
+            doubledPairs[i] |= (unsigned short)((pair | pair << 2) << (j * 4));
+        }
+    }
+}
+
+// Fill all bytes of a 64-bit value with a color index
+inline unsigned long long Splat(unsigned char color)
+{
+    return color * 0x0101010101010101ULL;
+}
+
+// Expand a byte of hires pixel data to 8 pixels
+inline void ExpandHires(unsigned char* dest, unsigned char data, unsigned char fgColor, unsigned char bgColor)
+{
+    unsigned long long mask = hiresMasks[data];
+    unsigned long long pixels = (Splat(fgColor) & mask) | (Splat(bgColor) & ~mask);
+    memcpy(dest, &pixels, 8);
+}
+
+// Expand a byte of multicolor pixel data to 8 pixels, with each bit pair selecting one of four colors
+inline void ExpandMulticolor(unsigned char* dest, unsigned char data, unsigned char color0, unsigned char color1, unsigned char color2, unsigned char color3)
+{
+    unsigned long long high = multicolorHighMasks[data];
+    unsigned long long low = multicolorLowMasks[data];
+    unsigned long long highColors = (Splat(color3) & low) | (Splat(color2) & ~low);
+    unsigned long long lowColors = (Splat(color1) & low) | (Splat(color0) & ~low);
+    unsigned long long pixels = (highColors & high) | (lowColors & ~high);
+    memcpy(dest, &pixels, 8);
+}
+
+// Expand a row of sprite data to its colors and opacity mask, 24 pixels wide or 48 if X-expanded. The colors are zero
+// where the mask is, so they can be blitted with an AND and an OR. Returns the width
+inline int VIC2::ExpandSpriteRow(const SpriteLineState& sprite, unsigned char mc1, unsigned char mc2, unsigned char* colors, unsigned char* mask)
+{
+    unsigned char data[6];
+    int numBytes = 3;
+    if (sprite.xExpand)
+    {
+        // Double each pixel, or each bit pair for multicolor
+        const unsigned short* doubled = sprite.multicolor ? doubledPairs : doubledBits;
+        for (int i = 0; i < 3; ++i)
+        {
+            data[i * 2] = (unsigned char)(doubled[sprite.data[i]] >> 8);
+            data[i * 2 + 1] = (unsigned char)(doubled[sprite.data[i]] & 0xff);
+        }
+        numBytes = 6;
+    }
+    else
+    {
+        for (int i = 0; i < 3; ++i)
+            data[i] = sprite.data[i];
+    }
+
+    for (int i = 0; i < numBytes; ++i)
+    {
+        unsigned long long opaque;
+        unsigned long long pixels;
+        if (sprite.multicolor)
+        {
+            // Bit pairs: 01 = multicolor 1, 10 = sprite color, 11 = multicolor 2
+            unsigned long long high = multicolorHighMasks[data[i]];
+            unsigned long long low = multicolorLowMasks[data[i]];
+            opaque = high | low;
+            pixels = (Splat(mc2) & high & low) | (Splat(sprite.color) & high & ~low) | (Splat(mc1) & ~high & low);
+        }
+        else
+        {
+            opaque = hiresMasks[data[i]];
+            pixels = Splat(sprite.color) & opaque;
+        }
+        memcpy(&colors[i * 8], &pixels, 8);
+        memcpy(&mask[i * 8], &opaque, 8);
+    }
+
+    return numBytes * 8;
+}
+
+// Mix a 64-bit value into a line signature. Each step is a bijection of the value, so a line that differs in just one
+// mixed value never keeps its signature
+inline unsigned long long MixSignature(unsigned long long signature, unsigned long long value)
+{
+    return (signature ^ value) * 0x100000001b3ULL;
+}
+
+// Mix a 40-byte per-char array into a line signature
+inline unsigned long long MixSignature(unsigned long long signature, const unsigned char* data)
+{
+    for (int i = 0; i < 40; i += 8)
+    {
+        unsigned long long value;
+        memcpy(&value, data + i, 8);
+        signature = MixSignature(signature, value);
+    }
+    return signature;
+}
+
+// Line renderers specialized for each display mode, with or without 38 column borders and horizontal scroll
+const VIC2::LineRenderer VIC2::_lineRenderers[NUM_DISPLAY_MODES][2][2] = {
+    { { &VIC2::RenderLine<DisplayChar, false, false>, &VIC2::RenderLine<DisplayChar, false, true> },
+      { &VIC2::RenderLine<DisplayChar, true, false>, &VIC2::RenderLine<DisplayChar, true, true> } },
+    { { &VIC2::RenderLine<DisplayMulticolorChar, false, false>, &VIC2::RenderLine<DisplayMulticolorChar, false, true> },
+      { &VIC2::RenderLine<DisplayMulticolorChar, true, false>, &VIC2::RenderLine<DisplayMulticolorChar, true, true> } },
+    { { &VIC2::RenderLine<DisplayExtendedColor, false, false>, &VIC2::RenderLine<DisplayExtendedColor, false, true> },
+      { &VIC2::RenderLine<DisplayExtendedColor, true, false>, &VIC2::RenderLine<DisplayExtendedColor, true, true> } },
+    { { &VIC2::RenderLine<DisplayBitmap, false, false>, &VIC2::RenderLine<DisplayBitmap, false, true> },
+      { &VIC2::RenderLine<DisplayBitmap, true, false>, &VIC2::RenderLine<DisplayBitmap, true, true> } },
+    { { &VIC2::RenderLine<DisplayMulticolorBitmap, false, false>, &VIC2::RenderLine<DisplayMulticolorBitmap, false, true> },
+      { &VIC2::RenderLine<DisplayMulticolorBitmap, true, false>, &VIC2::RenderLine<DisplayMulticolorBitmap, true, true> } }
+};
 
 VIC2::VIC2(RAM64K& ram) :
-    _ram(ram)
+    _ram(ram),
+    _rasterLine(0),
+    _videoBankSelect(0),
+    _lineNum(0),
+    _nextGlyphCache(0),
+    _renderMode(RenderImmediate),
+    _captureBuffer(0),
+    _renderBuffer(0),
+    _renderLineCount(0)
+#ifdef THREADS_SUPPORTED
+    ,
+    _renderThreadRunning(false),
+    _renderPending(false),
+    _renderThreadQuit(false)
+#endif
+{
+    static bool masksInitialized = false;
+    if (!masksInitialized)
+    {
+        InitExpandMasks();
+        masksInitialized = true;
+    }
+
+    for (int i = 0; i < NUM_REGISTERS; ++i)
+        _registers[i] = 0;
+    for (int i = 0; i < 1024; ++i)
+        _colorRam[i] = 0;
+    for (int i = 0; i < GLYPH_CACHE_SLOTS; ++i)
+        _glyphCaches[i].used = false;
+    for (int i = 0; i < 200; ++i)
+    {
+        _lineSignatures[i] = 0;
+        _lineValid[i] = false;
+        _lineDirty[i] = false;
+    }
+
+    _ram.RegisterIORead(0xd011, 0xd012, this);
+    _ram.RegisterIORead(0xd01e, 0xd01f, this);
+    _ram.RegisterIORead(0xd030, 0xd030, this);
+    // $d011, $d012 and $d01a are forwarded by Emulator, which also schedules the raster IRQ
+    _ram.RegisterIOWrite(0xd000, 0xd010, this);
+    _ram.RegisterIOWrite(0xd013, 0xd019, this);
+    _ram.RegisterIOWrite(0xd01b, 0xd000 + NUM_REGISTERS - 1, this);
+    _ram.RegisterIOWrite(0xd800, 0xdbff, this);
+    _ram.RegisterIOWrite(0xdd00, 0xdd00, this);
+}
+
+VIC2::~VIC2()
+{
+#ifdef THREADS_SUPPORTED
+    if (_renderThreadRunning)
+    {
+        WaitRenderThread();
+        _renderThreadQuit = true;
+        sem_post(&_renderStart);
+        pthread_join(_renderThread, nullptr);
+        sem_destroy(&_renderStart);
+        sem_destroy(&_renderDone);
+    }
+#endif
+}
+
+void VIC2::SetRenderMode(RenderMode mode)
 {
+#ifdef THREADS_SUPPORTED
+    // Let a frame in flight finish before its buffers are used from this thread again
+    WaitRenderThread();
+
+    if (mode == RenderThreaded && !_renderThreadRunning)
+    {
+        sem_init(&_renderStart, 0, 0);
+        sem_init(&_renderDone, 0, 0);
+        _renderThreadRunning = pthread_create(&_renderThread, nullptr, RenderThread, this) == 0;
+        if (!_renderThreadRunning)
+        {
+            sem_destroy(&_renderStart);
+            sem_destroy(&_renderDone);
+            mode = RenderDeferred;
+        }
+    }
+#else
+    if (mode == RenderThreaded)
+        mode = RenderDeferred;
+#endif
+
+    _renderMode = mode;
+}
+
+void VIC2::IOWrite(unsigned short address, unsigned char value)
+{
+    if (address >= 0xd800)
+        _colorRam[address - 0xd800] = (unsigned char)(value & 0xf);
+    else if (address == 0xdd00)
+        _videoBankSelect = value;
+    // Collision registers are read-only
+    else if (address != 0xd01e && address != 0xd01f)
+        _registers[address - 0xd000] = value;
+}
+
+unsigned char VIC2::IORead(unsigned short address)
+{
+    switch (address)
+    {
+        case 0xd011:
+            return (unsigned char)((_rasterLine >= 0x100 ? 0x80 : 0x00) | (Register(0xd011) & 0x7f));
+
+        case 0xd012:
+            return (unsigned char)(_rasterLine & 0xff);
+
+        // Collision registers are cleared when read
+        case 0xd01e:
+        case 0xd01f:
+            {
+                unsigned char value = Register(address);
+                _registers[address - 0xd000] = 0;
+                return value;
+            }
+
+        default:
+            // $d030 is the C128 clock register, reads as unconnected
+            return 0xff;
+    }
 }
 
 void VIC2::BeginFrame()
@@ -62,274 +326,294 @@ void VIC2::DoBadLine(int yScroll)
     ++_charRow;
 }
 
+VIC2::GlyphCache& VIC2::CharsetGlyphs(unsigned short base)
+{
+    unsigned char firstPage = (unsigned char)(base >> 8);
+    for (int i = 0; i < GLYPH_CACHE_SLOTS; ++i)
+    {
+        GlyphCache& cache = _glyphCaches[i];
+        if (!cache.used || cache.base != base)
+            continue;
+
+        // Drop the 32 glyphs of each page that was changed since they were copied
+        for (int j = 0; j < CHARSET_SIZE / 256; ++j)
+        {
+            unsigned generation = _ram.DataGeneration((unsigned char)(firstPage + j));
+            if (cache.pageGenerations[j] != generation)
+            {
+                cache.pageGenerations[j] = generation;
+                for (int k = j * 32; k < (j + 1) * 32; ++k)
+                    cache.valid[k] = false;
+            }
+        }
+        return cache;
+    }
+
+    // Move the least recently added cache and its write watch to the new charset
+    GlyphCache& cache = _glyphCaches[_nextGlyphCache];
+    _nextGlyphCache = (_nextGlyphCache + 1) % GLYPH_CACHE_SLOTS;
+    if (cache.used)
+        _ram.WatchData(cache.base, (unsigned short)(cache.base + CHARSET_SIZE - 1), false);
+    _ram.WatchData(base, (unsigned short)(base + CHARSET_SIZE - 1), true);
+    cache.base = base;
+    cache.used = true;
+    for (int i = 0; i < CHARSET_SIZE / 256; ++i)
+        cache.pageGenerations[i] = _ram.DataGeneration((unsigned char)(firstPage + i));
+    for (int i = 0; i < 256; ++i)
+        cache.valid[i] = false;
+    return cache;
+}
+
+inline const unsigned char* VIC2::GlyphRows(GlyphCache& cache, unsigned char code)
+{
+    if (!cache.valid[code])
+    {
+        unsigned short address = (unsigned short)(cache.base + code * 8);
+        for (int i = 0; i < 8; ++i)
+            cache.rows[code][i] = _ram.ReadRAM((unsigned short)(address + i));
+        cache.valid[code] = true;
+    }
+    return cache.rows[code];
+}
+
+template <DisplayMode Mode, bool HBorders, bool Scrolled> void VIC2::RenderLine(unsigned char* pixels, const LineState& state)
+{
+    // With horizontal scroll, render whole chars into the line buffer shifted right by xScroll. The pixels scrolled in
+    // from the left show the background, or the extended background color of the first char
+    unsigned char* dest = pixels;
+    if (Scrolled)
+    {
+        unsigned char leftColor = Mode == DisplayExtendedColor ? state.colors[state.chars[0] >> 6] : state.colors[0];
+        for (int i = 0; i < state.xScroll; ++i)
+            _lineBuffer[i] = leftColor;
+        dest = &_lineBuffer[state.xScroll];
+    }
+
+    for (int i = 0; i < 40; ++i, dest += 8)
+        RenderChar<Mode>(dest, i, state);
+
+    if (Scrolled)
+        memcpy(pixels, _lineBuffer, 320);
+
+    // 38 column mode
+    if (HBorders)
+    {
+        for (int i = 0; i < 7; ++i)
+            pixels[i] = state.borderColor;
+        for (int i = 311; i < 320; ++i)
+            pixels[i] = state.borderColor;
+    }
+}
+
+template <DisplayMode Mode> inline void VIC2::RenderChar(unsigned char* dest, int index, const LineState& state)
+{
+    if (Mode == DisplayChar || Mode == DisplayMulticolorChar)
+    {
+        unsigned char charByte = state.data[index];
+        unsigned char color = state.charColors[index];
+
+        // Multicolor chars use the color RAM high bit to select multicolor
+        if (Mode == DisplayMulticolorChar && color >= 0x8)
+            ExpandMulticolor(dest, charByte, state.colors[0], state.colors[1], state.colors[2], color & 0x7);
+        else
+            ExpandHires(dest, charByte, color, state.colors[0]);
+    }
+    else if (Mode == DisplayExtendedColor)
+    {
+        ExpandHires(dest, state.data[index], state.charColors[index], state.colors[state.chars[index] >> 6]);
+    }
+    else
+    {
+        unsigned char charByte = state.data[index];
+        unsigned char colors = state.chars[index];
+
+        if (Mode == DisplayMulticolorBitmap)
+            ExpandMulticolor(dest, charByte, state.colors[0], colors >> 4, colors & 0xf, state.charColors[index]);
+        // HACK: empty bytes show the background color instead of the bitmap color
+        else if (charByte == 0)
+            ExpandHires(dest, charByte, state.colors[0], state.colors[0]);
+        else
+            ExpandHires(dest, charByte, colors >> 4, colors & 0xf);
+    }
+}
+
 void VIC2::RenderNextLine()
 {
     if (_lineNum >= 200)
         return;
 
-    int pixelStart = (199 - _lineNum) * 320;
+    LineState& state = _lineStates[_captureBuffer][_lineNum];
+    CaptureLine(state);
+    if (_renderMode == RenderImmediate)
+        RenderCapturedLine(state, _lineNum);
+
+    // Done, increment linecount
+    ++_lineNum;
+}
+
+void VIC2::EndFrame()
+{
+    if (_renderMode == RenderDeferred)
+    {
+        for (int i = 0; i < _lineNum; ++i)
+            RenderCapturedLine(_lineStates[_captureBuffer][i], i);
+    }
+#ifdef THREADS_SUPPORTED
+    else if (_renderMode == RenderThreaded)
+        WaitRenderThread();
+#endif
+}
+
+void VIC2::BeginRender()
+{
+#ifdef THREADS_SUPPORTED
+    if (_renderMode == RenderThreaded)
+    {
+        // Hand the captured frame to the worker thread and capture the next frame to the other buffer. The semaphores
+        // order the buffer accesses between the threads, so no lock is needed
+        _renderBuffer = _captureBuffer;
+        _renderLineCount = _lineNum;
+        _captureBuffer ^= 1;
+        _renderPending = true;
+        sem_post(&_renderStart);
+    }
+#endif
+}
+
+#ifdef THREADS_SUPPORTED
+void VIC2::WaitRenderThread()
+{
+    if (_renderPending)
+    {
+        sem_wait(&_renderDone);
+        _renderPending = false;
+    }
+}
+
+void* VIC2::RenderThread(void* data)
+{
+    VIC2* vic2 = (VIC2*)data;
+
+    for (;;)
+    {
+        sem_wait(&vic2->_renderStart);
+        if (vic2->_renderThreadQuit)
+            break;
 
-    unsigned black = _palette[0];
-    unsigned bgColor = _palette[_ram.ReadIO(0xd021) & 0xf];
-    unsigned borderColor = _palette[_ram.ReadIO(0xd020) & 0xf];
+        const LineState* states = vic2->_lineStates[vic2->_renderBuffer];
+        for (int i = 0; i < vic2->_renderLineCount; ++i)
+            vic2->RenderCapturedLine(states[i], i);
 
-    unsigned char control = _ram.ReadIO(0xd011);
+        sem_post(&vic2->_renderDone);
+    }
+
+    return nullptr;
+}
+#endif
+
+void VIC2::CaptureLine(LineState& state)
+{
+    unsigned char bgColor = Register(0xd021) & 0xf;
+    unsigned char borderColor = Register(0xd020) & 0xf;
+
+    unsigned char control = Register(0xd011);
     int yScroll = control & 0x7;
-    int xScroll = _ram.ReadIO(0xd016) & 0x7;
-    bool hBorders = (_ram.ReadIO(0xd016) & 0x8) == 0;
+    int xScroll = Register(0xd016) & 0x7;
+    bool hBorders = (Register(0xd016) & 0x8) == 0;
     bool vBorders = (control & 0x8) == 0;
     bool displayEnable = (control & 0x10) != 0;
     bool bitmapMode = (control & 0x20) != 0;
-    bool multiColor = (_ram.ReadIO(0xd016) & 0x10) != 0;
+    bool multiColor = (Register(0xd016) & 0x10) != 0;
     bool ebcMode = (control & 0x40) != 0;
 
-    unsigned short videoBank = (0xc000 - (_ram.ReadIO(0xdd00) & 0x3) * 0x4000);
-    unsigned short charData = (videoBank + (_ram.ReadIO(0xd018) & 0xe) * 0x400);
-    unsigned short bitmapData = (videoBank + (_ram.ReadIO(0xd018) & 0x8) * 0x400);
-    unsigned short screenAddress = (videoBank + (_ram.ReadIO(0xd018) & 0xf0) * 0x40);
+    unsigned short videoBank = (0xc000 - (_videoBankSelect & 0x3) * 0x4000);
+    unsigned short charData = (videoBank + (Register(0xd018) & 0xe) * 0x400);
+    unsigned short bitmapData = (videoBank + (Register(0xd018) & 0x8) * 0x400);
+    unsigned short screenAddress = (videoBank + (Register(0xd018) & 0xf0) * 0x40);
 
-    unsigned mc1 = _palette[_ram.ReadIO(0xd022) & 0xf];
-    unsigned mc2 = _palette[_ram.ReadIO(0xd023) & 0xf];
-    unsigned mc3 = _palette[_ram.ReadIO(0xd024) & 0xf];
+    unsigned char mc1 = Register(0xd022) & 0xf;
+    unsigned char mc2 = Register(0xd023) & 0xf;
+    unsigned char mc3 = Register(0xd024) & 0xf;
 
     if ((_lineNum == 0 && ((_lineNum + 3) & 0x7) >= yScroll) || (((_lineNum + 3) & 0x7) == yScroll && _lineNum >= _nextBadlineLineNum))
         DoBadLine(yScroll);
 
-    // HACK for Hessian scrolling: actually get chars & colors every line
-    if (!_idleState)
-    {
-        for (int i = 0; i < 40; ++i)
-        {
-            _lineChars[i] = _ram.ReadRAM((screenAddress + _currentCharRow * 40 + i));
-            _lineColors[i] = (unsigned char)(_ram.ReadIO((0xd800 + _currentCharRow * 40 + i)) & 0xf);
-        }
-    }
-
-    int charIndex = 0;
     int charRow = (_lineNum + 3 - yScroll) & 0x7;
-    int bit = 0x80 << xScroll;
 
-    bool renderSprites = true;
+    state.hBorders = hBorders;
+    state.xScroll = xScroll;
+    state.borderColor = borderColor;
+
+    // Classify the line and start its signature from the values that affect it. The signature covers everything the
+    // line's pixels depend on, so a line with an unchanged signature can keep the previous frame's pixels
 
     // V-border or display off
     if (!displayEnable || (vBorders && (_lineNum < 4 || _lineNum >= 196)))
     {
-        for (int i = 0; i < 320; ++i)
-            _pixels[pixelStart + i] = borderColor;
-        renderSprites = false;
+        state.kind = LineBorder;
+        state.signature = MixSignature(SIGNATURE_SEED, LineBorder | borderColor << 4);
     }
     else
     // Idle state or illegal mode (render just black)
     if (_idleState || (ebcMode && multiColor))
     {
-        for (int i = 0; i < 320; ++i)
-            _pixels[pixelStart + i] = black;
+        state.kind = LineBlack;
+        state.signature = MixSignature(SIGNATURE_SEED, LineBlack | (hBorders ? 1 : 0) << 4);
     }
-    // Charmode
-    else if (!bitmapMode)
+    else
     {
-        unsigned char charByte = ebcMode ? _ram.ReadRAM((charData + (_lineChars[charIndex] & 0x3f) * 8 + charRow)) :
-            _ram.ReadRAM((charData + _lineChars[charIndex] * 8 + charRow));
-
-        // Singlecolor
-        if (!multiColor)
+        DisplayMode mode = bitmapMode ? (multiColor ? DisplayMulticolorBitmap : DisplayBitmap) :
+            ebcMode ? DisplayExtendedColor : (multiColor ? DisplayMulticolorChar : DisplayChar);
+        state.kind = LineDisplay;
+        state.mode = mode;
+        state.colors[0] = bgColor;
+        state.colors[1] = mc1;
+        state.colors[2] = mc2;
+        state.colors[3] = mc3;
+
+        // HACK for Hessian scrolling: actually get chars & colors every line
+        for (int i = 0; i < 40; ++i)
         {
-            for (int i = 0; i < 320; ++i)
-            {
-                if (hBorders && (i < 7 || i >= 311))
-                    _pixels[pixelStart + i] = borderColor;
-                else
-                {
-                    if (bit > 0x80 || charByte == 0 || (charByte & bit) == 0)
-                    {
-                        if (!ebcMode)
-                            _pixels[pixelStart + i] = bgColor;
-                        else
-                        {
-                            switch (_lineChars[charIndex] >> 6)
-                            {
-                                case 0:
-                                    _pixels[pixelStart + i] = bgColor;
-                                    break;
-                                case 1:
-                                    _pixels[pixelStart + i] = mc1;
-                                    break;
-                                case 2:
-                                    _pixels[pixelStart + i] = mc2;
-                                    break;
-                                case 3:
-                                    _pixels[pixelStart + i] = mc3;
-                                    break;
-                            }
-                        }
-                    }
-                    else
-                        _pixels[pixelStart + i] = _palette[_lineColors[charIndex]];
-                }
-
-                bit >>= 1;
-                if (bit == 0)
-                {
-                    bit = 0x80;
-                    ++charIndex;
-                    if (charIndex < 40)
-                    {
-                        charByte = ebcMode ? _ram.ReadRAM((charData + (_lineChars[charIndex] & 0x3f) * 8 + charRow)) :
-                            _ram.ReadRAM((charData + _lineChars[charIndex] * 8 + charRow));
-                    }
-                }
-            }
+            state.chars[i] = _ram.ReadRAM((screenAddress + _currentCharRow * 40 + i));
+            state.charColors[i] = _colorRam[_currentCharRow * 40 + i];
         }
-        // Multicolor
-        else
-        {
-            int bitPairShift = 0x7 + xScroll;
 
-            for (int i = 0; i < 320; ++i)
-            {
-                if (hBorders && (i < 7 || i >= 311))
-                    _pixels[pixelStart + i] = borderColor;
-                else
-                {
-                    if (bit > 0x80 || charByte == 0)
-                        _pixels[pixelStart + i] = bgColor;
-                    else
-                    {
-                        if (_lineColors[charIndex] < 0x8)
-                        {
-                            if ((charByte & bit) != 0)
-                                _pixels[pixelStart + i] = _palette[_lineColors[charIndex]];
-                            else
-                                _pixels[pixelStart + i] = bgColor;
-                        }
-                        else
-                        {
-                            unsigned char bitPair = (unsigned char)((charByte >> (bitPairShift & 0x6)) & 0x3);
-                            switch (bitPair)
-                            {
-                                case 0:
-                                    _pixels[pixelStart + i] = bgColor;
-                                    break;
-                                case 1:
-                                    _pixels[pixelStart + i] = mc1;
-                                    break;
-                                case 2:
-                                    _pixels[pixelStart + i] = mc2;
-                                    break;
-                                case 3:
-                                    _pixels[pixelStart + i] = _palette[_lineColors[charIndex] & 0x7];
-                                    break;
-                            }
-                        }
-                    }
-                }
-
-                bit >>= 1;
-                --bitPairShift;
-                if (bit == 0)
-                {
-                    bit = 0x80;
-                    bitPairShift = 0x7;
-                    ++charIndex;
-                    if (charIndex < 40)
-                        charByte = _ram.ReadRAM((charData + _lineChars[charIndex] * 8 + charRow));
-                }
-            }
-        }
-    }
-    else if (bitmapMode)
-    {
-        unsigned char charByte = _ram.ReadRAM((bitmapData + _bitmapRow * 320 + charIndex * 8 + charRow));
-
-        // Singlecolor
-        if (!multiColor)
+        // Fetch the char or bitmap byte of each char on this line
+        if (mode == DisplayBitmap || mode == DisplayMulticolorBitmap)
         {
-            for (int i = 0; i < 320; ++i)
-            {
-                if (hBorders && (i < 7 || i >= 311))
-                    _pixels[pixelStart + i] = borderColor;
-                else
-                {
-                    if (bit > 0x80 || charByte == 0)
-                        _pixels[pixelStart + i] = bgColor;
-                    else
-                    {
-                        if ((charByte & bit) != 0)
-                            _pixels[pixelStart + i] = _palette[_lineChars[charIndex] >> 4];
-                        else
-                            _pixels[pixelStart + i] = _palette[_lineChars[charIndex] & 0xf];
-                    }
-                }
-
-                bit >>= 1;
-                if (bit == 0)
-                {
-                    bit = 0x80;
-                    ++charIndex;
-                    if (charIndex < 40)
-                        charByte = _ram.ReadRAM((bitmapData + _bitmapRow * 320 + charIndex * 8 + charRow));
-                }
-            }
+            unsigned short bitmapRowAddress = (unsigned short)(bitmapData + _bitmapRow * 320 + charRow);
+            for (int i = 0; i < 40; ++i)
+                state.data[i] = _ram.ReadRAM((unsigned short)(bitmapRowAddress + i * 8));
         }
-        // Multicolor
         else
         {
-            int bitPairShift = 0x7 + xScroll;
-
-            for (int i = 0; i < 320; ++i)
-            {
-                if (hBorders && (i < 7 || i >= 311))
-                    _pixels[pixelStart + i] = borderColor;
-                else
-                {
-                    if (bit > 0x80 || charByte == 0)
-                        _pixels[pixelStart + i] = bgColor;
-                    else
-                    {
-                        unsigned char bitPair = (unsigned char)((charByte >> (bitPairShift & 0x6)) & 0x3);
-                        switch (bitPair)
-                        {
-                            case 0:
-                                _pixels[pixelStart + i] = bgColor;
-                                break;
-                            case 1:
-                                _pixels[pixelStart + i] = _palette[_lineChars[charIndex] >> 4];
-                                break;
-                            case 2:
-                                _pixels[pixelStart + i] = _palette[_lineChars[charIndex] & 0xf];
-                                break;
-                            case 3:
-                                _pixels[pixelStart + i] = _palette[_lineColors[charIndex] & 0xf];
-                                break;
-                        }
-                    }
-                }
-
-                bit >>= 1;
-                --bitPairShift;
-                if (bit == 0)
-                {
-                    bit = 0x80;
-                    bitPairShift = 0x7;
-                    ++charIndex;
-                    if (charIndex < 40)
-                        charByte = _ram.ReadRAM((bitmapData + _bitmapRow * 320 + charIndex * 8 + charRow));
-                }
-            }
+            GlyphCache& glyphs = CharsetGlyphs(charData);
+            unsigned char charMask = mode == DisplayExtendedColor ? 0x3f : 0xff;
+            for (int i = 0; i < 40; ++i)
+                state.data[i] = GlyphRows(glyphs, state.chars[i] & charMask)[charRow];
         }
+
+        state.signature = MixSignature(SIGNATURE_SEED, LineDisplay | mode << 4 | (hBorders ? 1 : 0) << 8 | xScroll << 12 |
+            borderColor << 16 | bgColor << 20 | mc1 << 24 | (unsigned long long)mc2 << 28 | (unsigned long long)mc3 << 32);
+        state.signature = MixSignature(state.signature, state.chars);
+        state.signature = MixSignature(state.signature, state.charColors);
+        state.signature = MixSignature(state.signature, state.data);
     }
 
-    unsigned char spriteFlags = _ram.ReadIO(0xd015);
-    unsigned char spriteMCFlags = _ram.ReadIO(0xd01c);
-    unsigned char spriteXMSBFlags = _ram.ReadIO(0xd010);
-    unsigned char spriteXExpandFlags = _ram.ReadIO(0xd01d);
+    unsigned char spriteFlags = Register(0xd015);
+    unsigned char spriteMCFlags = Register(0xd01c);
+    unsigned char spriteXMSBFlags = Register(0xd010);
+    unsigned char spriteXExpandFlags = Register(0xd01d);
+    unsigned char spritePriorityFlags = Register(0xd01b);
 
-    unsigned sprMc1 = _palette[_ram.ReadIO(0xd025) & 0xf];
-    unsigned sprMc2 = _palette[_ram.ReadIO(0xd026) & 0xf];
+    state.spriteMc1 = Register(0xd025) & 0xf;
+    state.spriteMc2 = Register(0xd026) & 0xf;
+    state.visibleSprites = 0;
 
+    // Advance the sprites and collect the row data of the visible ones
     for (int i = 7; i >= 0; --i)
     {
-        unsigned char spriteY = _ram.ReadIO((0xd001 + i * 2));
+        unsigned char spriteY = Register(0xd001 + i * 2);
         if (!_spriteActive[i] && (spriteFlags & bitValues[i]) != 0)
         {
             if (_lineNum == spriteY - 50 || (_lineNum == 0 && spriteY >= 30 && spriteY < 50))
@@ -341,53 +625,31 @@ void VIC2::RenderNextLine()
 
         if (_spriteActive[i])
         {
-            // TODO: Y expansion, background priority
-            if (renderSprites)
+            // TODO: Y expansion
+            if (state.kind != LineBorder)
             {
-                int startX = _ram.ReadIO((0xd000 + i * 2));
+                SpriteLineState& sprite = state.sprites[i];
+                int startX = Register(0xd000 + i * 2);
                 if ((spriteXMSBFlags & bitValues[i]) != 0)
                     startX += 256;
-                bool xExpand = (spriteXExpandFlags & bitValues[i]) != 0;
-                if (xExpand && startX >= 480 && startX < 504)
+                sprite.xExpand = (spriteXExpandFlags & bitValues[i]) != 0;
+                if (sprite.xExpand && startX >= 480 && startX < 504)
                     startX -= 504;
 
                 unsigned short spriteData = (videoBank + _ram.ReadRAM((screenAddress + 0x3f8 + i)) * 0x40 + _spriteRow[i] * 3);
-                unsigned spriteColor = _palette[_ram.ReadIO((0xd027 + i)) & 0xf];
-
-                for (int j = 0; j < 24; ++j)
-                {
-                    int k = xExpand ? (startX + j * 2 - 24) : (startX + j - 24);
-                    unsigned char spriteByte = _ram.ReadRAM((spriteData + (j >> 3)));
-
-                    for (int l = 0; l < (xExpand ? 2 : 1); ++l)
-                    {
-                        if (k >= 0 && k <= 320 && (!hBorders || (k >= 7 && k < 311)) && spriteByte != 0)
-                        {
-                            if ((spriteMCFlags & bitValues[i]) != 0)
-                            {
-                                unsigned char bitPair = ((spriteByte >> (6 - (j & 0x6))) & 0x3);
-                                switch (bitPair)
-                                {
-                                    case 1:
-                                        _pixels[pixelStart + k] = sprMc1;
-                                        break;
-                                    case 2:
-                                        _pixels[pixelStart + k] = spriteColor;
-                                        break;
-                                    case 3:
-                                        _pixels[pixelStart + k] = sprMc2;
-                                        break;
-                                }
-                            }
-                            else
-                            {
-                                if ((spriteByte & bitValues[7 - (j & 0x7)]) != 0)
-                                    _pixels[pixelStart + k] = spriteColor;
-                            }
-                        }
-                        ++k;
-                    }
-                }
+                for (int j = 0; j < 3; ++j)
+                    sprite.data[j] = _ram.ReadRAM((unsigned short)(spriteData + j));
+                sprite.x = (short)startX;
+                sprite.multicolor = (spriteMCFlags & bitValues[i]) != 0;
+                sprite.behindForeground = (spritePriorityFlags & bitValues[i]) != 0;
+                sprite.color = Register(0xd027 + i) & 0xf;
+                state.visibleSprites |= bitValues[i];
+
+                state.signature = MixSignature(state.signature, (unsigned long long)i | (startX & 0x3ff) << 3 |
+                    (sprite.xExpand ? 1 : 0) << 13 | (sprite.multicolor ? 1 : 0) << 14 |
+                    (sprite.behindForeground ? 1 : 0) << 15 | sprite.color << 16 |
+                    state.spriteMc1 << 20 | state.spriteMc2 << 24 | (unsigned long long)sprite.data[0] << 32 |
+                    (unsigned long long)sprite.data[1] << 40 | (unsigned long long)sprite.data[2] << 48);
             }
 
             ++_spriteRow[i];
@@ -396,6 +658,253 @@ void VIC2::RenderNextLine()
         }
     }
 
-    // Done, increment linecount
-    ++_lineNum;
-}
\ No newline at end of file
+    if (state.visibleSprites)
+        DetectCollisions(state);
+}
+
+void VIC2::DetectCollisions(const LineState& state)
+{
+    unsigned long long foreground[LINE_MASK_WORDS];
+    unsigned long long spriteMasks[8][LINE_MASK_WORDS];
+    BuildForegroundMask(state, foreground);
+
+    for (int i = 0; i < 8; ++i)
+    {
+        if ((state.visibleSprites & bitValues[i]) == 0)
+            continue;
+
+        BuildSpriteMask(state, state.sprites[i], spriteMasks[i]);
+
+        for (int w = 0; w < LINE_MASK_WORDS; ++w)
+        {
+            if (spriteMasks[i][w] & foreground[w])
+            {
+                _registers[0x1f] |= bitValues[i];
+                break;
+            }
+        }
+
+        for (int j = 0; j < i; ++j)
+        {
+            if ((state.visibleSprites & bitValues[j]) == 0)
+                continue;
+
+            for (int w = 0; w < LINE_MASK_WORDS; ++w)
+            {
+                if (spriteMasks[i][w] & spriteMasks[j][w])
+                {
+                    _registers[0x1e] |= bitValues[i] | bitValues[j];
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void VIC2::BuildForegroundMask(const LineState& state, unsigned long long* mask)
+{
+    for (int w = 0; w < LINE_MASK_WORDS; ++w)
+        mask[w] = 0;
+    if (state.kind != LineDisplay)
+        return;
+
+    // Hires pixels with a set bit and multicolor pixels with bit pair 10 or 11 are foreground
+    for (int i = 0; i < 40; ++i)
+    {
+        unsigned char data = state.data[i];
+        bool multicolor = state.mode == DisplayMulticolorBitmap || (state.mode == DisplayMulticolorChar && state.charColors[i] >= 0x8);
+        if (multicolor)
+            data = (unsigned char)((data & 0xaa) | (data & 0xaa) >> 1);
+        mask[i >> 3] |= (unsigned long long)data << (56 - (i & 7) * 8);
+    }
+
+    int xScroll = state.xScroll;
+    if (xScroll > 0)
+    {
+        for (int w = LINE_MASK_WORDS - 1; w > 0; --w)
+            mask[w] = mask[w] >> xScroll | mask[w - 1] << (64 - xScroll);
+        mask[0] >>= xScroll;
+    }
+
+    ClipLineMask(state, mask);
+}
+
+void VIC2::BuildSpriteMask(const LineState& state, const SpriteLineState& sprite, unsigned long long* mask)
+{
+    for (int w = 0; w < LINE_MASK_WORDS; ++w)
+        mask[w] = 0;
+
+    // Sprite pixels as bits from the highest down. Multicolor pixels are covered unless their bit pair is 00
+    unsigned long long bits = 0;
+    for (int i = 0; i < 3; ++i)
+    {
+        unsigned char data = sprite.data[i];
+        if (sprite.multicolor)
+        {
+            data = (unsigned char)((data & 0xaa) | (data & 0x55) << 1);
+            data |= data >> 1;
+        }
+        if (sprite.xExpand)
+            bits |= (unsigned long long)doubledBits[data] << (48 - i * 16);
+        else
+            bits |= (unsigned long long)data << (56 - i * 8);
+    }
+
+    int offset = sprite.x - 24;
+    if (offset < 0)
+    {
+        if (offset <= -64)
+            return;
+        bits <<= -offset;
+        offset = 0;
+    }
+
+    int word = offset >> 6;
+    int shift = offset & 63;
+    if (word < LINE_MASK_WORDS)
+        mask[word] |= bits >> shift;
+    if (shift > 0 && word + 1 < LINE_MASK_WORDS)
+        mask[word + 1] |= bits << (64 - shift);
+
+    ClipLineMask(state, mask);
+}
+
+void VIC2::ClipLineMask(const LineState& state, unsigned long long* mask)
+{
+    // 38 column mode hides pixels 0-6 and 311-319
+    if (state.hBorders)
+    {
+        mask[0] &= 0x01ffffffffffffffULL;
+        mask[LINE_MASK_WORDS - 1] &= 0xfffffffffffffe00ULL;
+    }
+}
+
+// Return 8 bits of a line mask starting from a pixel, the first pixel in the highest bit
+inline unsigned char MaskByte(const unsigned long long* mask, int x)
+{
+    int word = x >> 6;
+    int shift = x & 63;
+    unsigned long long bits = mask[word] << shift;
+    if (shift > 56 && word + 1 < LINE_MASK_WORDS)
+        bits |= mask[word + 1] >> (64 - shift);
+    return (unsigned char)(bits >> 56);
+}
+
+inline bool MaskBit(const unsigned long long* mask, int x)
+{
+    return ((mask[x >> 6] >> (63 - (x & 63))) & 1) != 0;
+}
+
+void VIC2::BlitSprite(unsigned char* pixels, const LineState& state, const SpriteLineState& sprite, int minX, int maxX, const unsigned long long* visible)
+{
+    unsigned char colors[48];
+    unsigned char mask[48];
+    int width = ExpandSpriteRow(sprite, state.spriteMc1, state.spriteMc2, colors, mask);
+
+    int left = sprite.x - 24;
+    int start = left > minX ? left : minX;
+    int end = left + width < maxX ? left + width : maxX;
+    int k = start;
+
+    for (; k + 8 <= end; k += 8)
+    {
+        unsigned long long dest;
+        unsigned long long spriteColors;
+        unsigned long long spriteMask;
+        memcpy(&dest, &pixels[k], 8);
+        memcpy(&spriteColors, &colors[k - left], 8);
+        memcpy(&spriteMask, &mask[k - left], 8);
+        if (visible)
+        {
+            spriteMask &= hiresMasks[MaskByte(visible, k)];
+            spriteColors &= spriteMask;
+        }
+        dest = (dest & ~spriteMask) | spriteColors;
+        memcpy(&pixels[k], &dest, 8);
+    }
+    for (; k < end; ++k)
+    {
+        if (!visible || MaskBit(visible, k))
+            pixels[k] = (pixels[k] & ~mask[k - left]) | colors[k - left];
+    }
+}
+
+void VIC2::RenderCapturedLine(const LineState& state, int lineNum)
+{
+    // Reuse the previous frame's pixels if nothing affecting the line changed
+    _lineDirty[lineNum] = !_lineValid[lineNum] || _lineSignatures[lineNum] != state.signature;
+    if (!_lineDirty[lineNum])
+        return;
+
+    _lineSignatures[lineNum] = state.signature;
+    _lineValid[lineNum] = true;
+
+    unsigned char* pixels = &_pixels[(199 - lineNum) * 320];
+
+    if (state.kind == LineBorder)
+    {
+        for (int i = 0; i < 320; ++i)
+            pixels[i] = state.borderColor;
+    }
+    else if (state.kind == LineBlack)
+    {
+        for (int i = 0; i < 320; ++i)
+            pixels[i] = 0;
+    }
+    else
+    {
+        LineRenderer renderer = _lineRenderers[state.mode][state.hBorders ? 1 : 0][state.xScroll > 0 ? 1 : 0];
+        (this->*renderer)(pixels, state);
+    }
+
+    // Sprites are clipped to the line, so that each line's pixels depend only on its own signature
+    int minX = state.hBorders ? 7 : 0;
+    int maxX = state.hBorders ? 311 : 320;
+
+    bool behindForeground = false;
+    for (int i = 0; i < 8; ++i)
+    {
+        if ((state.visibleSprites & bitValues[i]) != 0 && state.sprites[i].behindForeground)
+            behindForeground = true;
+    }
+
+    if (!behindForeground)
+    {
+        // Draw the lowest priority sprite first, so that lower numbered sprites end up on top
+        for (int i = 7; i >= 0; --i)
+        {
+            if ((state.visibleSprites & bitValues[i]) != 0)
+                BlitSprite(pixels, state, state.sprites[i], minX, maxX, nullptr);
+        }
+    }
+    else
+    {
+        // Resolve sprite to sprite priority first, then hide the pixels of sprites behind the foreground. A sprite
+        // behind the foreground also hides lower priority sprites below it, like on the real VIC
+        unsigned long long foreground[LINE_MASK_WORDS];
+        unsigned long long covered[LINE_MASK_WORDS];
+        BuildForegroundMask(state, foreground);
+        for (int w = 0; w < LINE_MASK_WORDS; ++w)
+            covered[w] = 0;
+
+        for (int i = 0; i < 8; ++i)
+        {
+            if ((state.visibleSprites & bitValues[i]) == 0)
+                continue;
+
+            const SpriteLineState& sprite = state.sprites[i];
+            unsigned long long spriteMask[LINE_MASK_WORDS];
+            unsigned long long visible[LINE_MASK_WORDS];
+            BuildSpriteMask(state, sprite, spriteMask);
+            for (int w = 0; w < LINE_MASK_WORDS; ++w)
+            {
+                visible[w] = spriteMask[w] & ~covered[w];
+                if (sprite.behindForeground)
+                    visible[w] &= ~foreground[w];
+                covered[w] |= spriteMask[w];
+            }
+
+            BlitSprite(pixels, state, sprite, minX, maxX, visible);
+        }
+    }
+}
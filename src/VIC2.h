@@ -26,24 +26,135 @@ const int NUM_LINES = 312;
 const int FIRST_VISIBLE_LINE = 50;
 const int FIRST_INVISIBLE_LINE = 250;
 const int CYCLES_PER_LINE = 63;
+const int NUM_REGISTERS = 0x2f;
+const int LINE_MASK_WORDS = 5; // 320 pixels as 64-bit words, the leftmost pixel in the highest bit
+const unsigned long long SIGNATURE_SEED = 0xcbf29ce484222325ULL;
+const int CHARSET_SIZE = 0x800;
+const int GLYPH_CACHE_SLOTS = 4;
 
-class RAM64K;
+#include "RAM64K.h"
+#include "Thread.h"
 
-class VIC2
+enum DisplayMode
+{
+    DisplayChar = 0,
+    DisplayMulticolorChar,
+    DisplayExtendedColor,
+    DisplayBitmap,
+    DisplayMulticolorBitmap,
+    NUM_DISPLAY_MODES
+};
+
+enum RenderMode
+{
+    RenderImmediate = 0, // Render each line as the raster reaches it
+    RenderDeferred, // Capture lines during the frame, render all in one pass at the frame end
+    RenderThreaded // Capture lines during the frame, render them on a worker thread while the next frame runs
+};
+
+enum LineKind
+{
+    LineBorder = 0,
+    LineBlack,
+    LineDisplay
+};
+
+class VIC2 : public IODevice
 {
 public:
     VIC2(RAM64K& ram);
+    ~VIC2();
     void BeginFrame();
     void RenderNextLine();
-    unsigned* Pixels() { return &_pixels[0]; }
+    // Finish rendering, after which the pixels hold the last completed frame. In threaded mode that is the previous
+    // frame, as the current one is rendered only after BeginRender has handed it to the worker thread
+    void EndFrame();
+    void BeginRender();
+    // Threaded mode falls back to deferred if worker threads are not supported
+    void SetRenderMode(RenderMode mode);
+    void SetRasterLine(int lineNum) { _rasterLine = lineNum; }
+    int RasterLine() const { return _rasterLine; }
+
+    unsigned char IORead(unsigned short address) override;
+    void IOWrite(unsigned short address, unsigned char value) override;
+    bool IOReadIsStable(unsigned short address) override { return address != 0xd01e && address != 0xd01f; }
+    unsigned char* Pixels() { return &_pixels[0]; }
+    // Flags for lines (0-199 from the top) re-rendered during the current frame. Unchanged lines keep their pixels
+    const bool* DirtyLines() const { return &_lineDirty[0]; }
 
     static unsigned char bitValues[8];
 
 private:
+    struct SpriteLineState
+    {
+        short x;
+        bool xExpand;
+        bool multicolor;
+        bool behindForeground;
+        unsigned char color;
+        unsigned char data[3];
+    };
+
+    // Everything a line's pixels depend on, captured when the raster reaches it so that rendering does not need the
+    // registers or memory anymore
+    struct LineState
+    {
+        unsigned long long signature;
+        LineKind kind;
+        DisplayMode mode;
+        bool hBorders;
+        int xScroll;
+        unsigned char borderColor;
+        unsigned char colors[4]; // Background and extended background / multicolors 1-3
+        unsigned char chars[40];
+        unsigned char charColors[40];
+        unsigned char data[40]; // Char or bitmap byte of each char
+        unsigned char visibleSprites;
+        unsigned char spriteMc1;
+        unsigned char spriteMc2;
+        SpriteLineState sprites[8];
+    };
+
+    // Glyph rows of one charset, copied on first use. The charset is write watched in RAM64K, and the glyphs of a page
+    // are dropped when a write changes it
+    struct GlyphCache
+    {
+        unsigned short base;
+        bool used;
+        unsigned pageGenerations[CHARSET_SIZE / 256];
+        bool valid[256];
+        unsigned char rows[256][8];
+    };
+
+    typedef void (VIC2::*LineRenderer)(unsigned char* pixels, const LineState& state);
+
     void DoBadLine(int yScroll);
+    GlyphCache& CharsetGlyphs(unsigned short base);
+    const unsigned char* GlyphRows(GlyphCache& cache, unsigned char code);
+    void CaptureLine(LineState& state);
+    void RenderCapturedLine(const LineState& state, int lineNum);
+    void DetectCollisions(const LineState& state);
+    static void BuildForegroundMask(const LineState& state, unsigned long long* mask);
+    static void BuildSpriteMask(const LineState& state, const SpriteLineState& sprite, unsigned long long* mask);
+    static void ClipLineMask(const LineState& state, unsigned long long* mask);
+    static void BlitSprite(unsigned char* pixels, const LineState& state, const SpriteLineState& sprite, int minX, int maxX, const unsigned long long* visible);
+    static int ExpandSpriteRow(const SpriteLineState& sprite, unsigned char mc1, unsigned char mc2, unsigned char* colors, unsigned char* mask);
+#ifdef THREADS_SUPPORTED
+    void WaitRenderThread();
+    static void* RenderThread(void* data);
+#endif
+    unsigned char Register(unsigned short address) const { return _registers[address - 0xd000]; }
+    template <DisplayMode Mode, bool HBorders, bool Scrolled> void RenderLine(unsigned char* pixels, const LineState& state);
+    template <DisplayMode Mode> void RenderChar(unsigned char* dest, int index, const LineState& state);
+
+    static const LineRenderer _lineRenderers[NUM_DISPLAY_MODES][2][2];
 
     RAM64K& _ram;
-    static unsigned _palette[16];
+    int _rasterLine;
+    // Latched copies of the VIC registers, color RAM and the CIA2 video bank select, updated on I/O writes
+    unsigned char _registers[NUM_REGISTERS];
+    unsigned char _colorRam[1024];
+    unsigned char _videoBankSelect;
     int _lineNum;
     int _nextBadlineLineNum;
     int _currentCharRow;
@@ -52,7 +163,26 @@ private:
     bool _idleState;
     bool _spriteActive[8];
     unsigned char _spriteRow[8];
-    unsigned char _lineChars[40];
-    unsigned char _lineColors[40];
-    unsigned _pixels[320*200];
+    // Caches for the charsets in use, reused in turn
+    GlyphCache _glyphCaches[GLYPH_CACHE_SLOTS];
+    int _nextGlyphCache;
+    RenderMode _renderMode;
+    // Lines are captured to one buffer while the worker thread renders the other
+    LineState _lineStates[2][200];
+    int _captureBuffer;
+    int _renderBuffer;
+    int _renderLineCount;
+#ifdef THREADS_SUPPORTED
+    pthread_t _renderThread;
+    sem_t _renderStart;
+    sem_t _renderDone;
+    bool _renderThreadRunning;
+    bool _renderPending;
+    bool _renderThreadQuit;
+#endif
+    unsigned long long _lineSignatures[200];
+    bool _lineValid[200];
+    bool _lineDirty[200];
+    unsigned char _lineBuffer[320+8];
+    unsigned char _pixels[320*200]; // Palette indices
 };
\ No newline at end of file
@@ -0,0 +1,45 @@
+// MIT License
+// 
+// Copyright (c) 2018-2026 Lasse Oorni
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <string>
+
+// Configuration of the headless platform backends. Video and audio are discarded unless an output file is set, and
+// saving is disabled unless a save directory is set. Hashes of all output are kept for regression testing
+class Headless
+{
+public:
+    static bool SetVideoFile(const std::string& fileName);
+    static bool SetAudioFile(const std::string& fileName);
+    static void SetSaveDirectory(const std::string& directory);
+    static unsigned long long VideoHash();
+    static unsigned long long AudioHash();
+};
+
+// FNV-1a hash step
+inline unsigned long long HashValue(unsigned long long hash, unsigned value)
+{
+    return (hash ^ value) * 1099511628211ULL;
+}
+
+const unsigned long long HASH_SEED = 14695981039346656037ULL;
@@ -0,0 +1,72 @@
+// MIT License
+// 
+// Copyright (c) 2018-2026 Lasse Oorni
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <stdio.h>
+#include "Audio.h"
+#include "Headless.h"
+
+FILE* audioFile = nullptr;
+unsigned long long audioHash = HASH_SEED;
+
+bool Headless::SetAudioFile(const std::string& fileName)
+{
+    audioFile = fopen(fileName.c_str(), "wb");
+    return audioFile != nullptr;
+}
+
+unsigned long long Headless::AudioHash()
+{
+    return audioHash;
+}
+
+void Audio::Init(int /*numBuffers*/)
+{
+}
+
+int Audio::NumFreeBuffers()
+{
+    // Consume audio as fast as it is produced
+    return 1;
+}
+
+bool Audio::QueueBuffer(short* samples, int numSamples)
+{
+    for (int i = 0; i < numSamples; ++i)
+        audioHash = HashValue(audioHash, (unsigned short)samples[i]);
+
+    // Raw signed 16-bit mono at 44100 Hz
+    if (audioFile)
+        fwrite(samples, sizeof(short), numSamples, audioFile);
+
+    return true;
+}
+
+bool Audio::StartStream(SampleRing* /*ring*/)
+{
+    // Output is consumed at the end of each frame instead, so that it does not depend on thread timing
+    return false;
+}
+
+bool Audio::IsStreaming()
+{
+    return false;
+}
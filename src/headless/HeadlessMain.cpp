@@ -0,0 +1,186 @@
+// MIT License
+// 
+// Copyright (c) 2018-2026 Lasse Oorni
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "Emulator.h"
+#include "Headless.h"
+#include "Screen.h"
+
+struct InputEvent
+{
+    int frame;
+    unsigned keyCode;
+    bool down;
+};
+
+bool InputEventLess(const InputEvent& lhs, const InputEvent& rhs)
+{
+    return lhs.frame < rhs.frame;
+}
+
+void PrintUsage()
+{
+    printf(
+        "Usage: oldschoolengine2-headless [options]\n"
+        "  --diskimage <name>  Disk image to run from the disk image directory (default steelrangerdemo)\n"
+        "  --diskdir <dir>     Directory containing the disk images (default diskimages in the current directory)\n"
+        "  --frames <count>    Number of frames to run (default 500)\n"
+        "  --input <file>      Input script with lines of <frame> <down|up> <keycode>\n"
+        "  --video <file>      Write frames as raw 320x200 RGBA\n"
+        "  --audio <file>      Write audio as raw signed 16-bit mono at 44100 Hz\n"
+        "  --savedir <dir>     Directory for save files. Saving is disabled if not given\n"
+        "  --jit               Compile hot code to native code if supported\n"
+        "  --deferred          Render each frame in one pass after emulating it\n"
+        "  --threaded          Render each frame on a worker thread while emulating the next\n"
+        "  --audiothread       Synthesize audio on a worker thread while emulating the next frame\n");
+}
+
+bool LoadInputScript(const char* fileName, std::vector<InputEvent>& events)
+{
+    FILE* file = fopen(fileName, "r");
+    if (!file)
+        return false;
+
+    char line[256];
+    while (fgets(line, sizeof line, file))
+    {
+        if (line[0] == '#')
+            continue;
+
+        InputEvent event;
+        char action[16];
+        if (sscanf(line, "%d %15s %u", &event.frame, action, &event.keyCode) != 3)
+            continue;
+        event.down = strcmp(action, "down") == 0;
+        events.push_back(event);
+    }
+
+    fclose(file);
+    std::stable_sort(events.begin(), events.end(), InputEventLess);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    std::string diskImageName;
+    std::string diskImageDirectory = "diskimages";
+    int numFrames = 500;
+    bool jit = false;
+    bool audioThreaded = false;
+    RenderMode renderMode = RenderImmediate;
+    std::vector<InputEvent> inputEvents;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string argument(argv[i]);
+        bool hasValue = i + 1 < argc;
+
+        if (argument == "--diskimage" && hasValue)
+            diskImageName = argv[++i];
+        else if (argument == "--diskdir" && hasValue)
+            diskImageDirectory = argv[++i];
+        else if (argument == "--frames" && hasValue)
+            numFrames = atoi(argv[++i]);
+        else if (argument == "--input" && hasValue)
+        {
+            if (!LoadInputScript(argv[++i], inputEvents))
+            {
+                printf("Failed to open input script %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (argument == "--video" && hasValue)
+        {
+            if (!Headless::SetVideoFile(argv[++i]))
+            {
+                printf("Failed to open video output %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (argument == "--audio" && hasValue)
+        {
+            if (!Headless::SetAudioFile(argv[++i]))
+            {
+                printf("Failed to open audio output %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (argument == "--savedir" && hasValue)
+            Headless::SetSaveDirectory(argv[++i]);
+        else if (argument == "--jit")
+            jit = true;
+        else if (argument == "--deferred")
+            renderMode = RenderDeferred;
+        else if (argument == "--threaded")
+            renderMode = RenderThreaded;
+        else if (argument == "--audiothread")
+            audioThreaded = true;
+        else
+        {
+            PrintUsage();
+            return argument == "--help" ? 0 : 1;
+        }
+    }
+
+    Emulator* emulator = new Emulator(diskImageName, diskImageDirectory);
+    if (!emulator->IsBooted())
+    {
+        printf("Failed to boot disk image %s from %s\n", diskImageName.empty() ? "steelrangerdemo" : diskImageName.c_str(),
+            diskImageDirectory.c_str());
+        delete emulator;
+        return 1;
+    }
+    emulator->SetJITEnabled(jit);
+    emulator->SetRenderMode(renderMode);
+    emulator->SetAudioThreaded(audioThreaded);
+
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+    unsigned nextEvent = 0;
+    unsigned long long bytesUploaded = 0;
+
+    for (int frame = 0; frame < numFrames; ++frame)
+    {
+        while (nextEvent < inputEvents.size() && inputEvents[nextEvent].frame <= frame)
+        {
+            const InputEvent& event = inputEvents[nextEvent++];
+            emulator->HandleKey(event.keyCode, event.down);
+        }
+
+        emulator->Update();
+        emulator->QueueAudio();
+        bytesUploaded += Screen::BytesUploaded();
+    }
+
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    printf("Ran %d frames in %.1f ms (%.1f fps)\n", numFrames, elapsed, elapsed > 0.0 ? numFrames * 1000.0 / elapsed : 0.0);
+    printf("Screen upload %.1f bytes per frame\n", numFrames > 0 ? (double)bytesUploaded / numFrames : 0.0);
+    printf("Video hash %016llx\n", Headless::VideoHash());
+    printf("Audio hash %016llx\n", Headless::AudioHash());
+
+    delete emulator;
+    return 0;
+}
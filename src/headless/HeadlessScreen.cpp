@@ -0,0 +1,75 @@
+// MIT License
+// 
+// Copyright (c) 2018-2026 Lasse Oorni
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <stdio.h>
+#include "Screen.h"
+#include "Palette.h"
+#include "Headless.h"
+
+FILE* videoFile = nullptr;
+unsigned long long videoHash = HASH_SEED;
+unsigned rgbaData[320 * 200];
+unsigned bytesUploaded = 0;
+
+bool Headless::SetVideoFile(const std::string& fileName)
+{
+    videoFile = fopen(fileName.c_str(), "wb");
+    return videoFile != nullptr;
+}
+
+unsigned long long Headless::VideoHash()
+{
+    return videoHash;
+}
+
+void Screen::Init()
+{
+}
+
+void Screen::Redraw(unsigned char* screenData, const bool* dirtyLines)
+{
+    // Convert only the changed rows, counting them like the web backend counts texture uploads
+    bytesUploaded = 0;
+    for (int y = 0; y < 200; ++y)
+    {
+        if (dirtyLines[199 - y])
+        {
+            Palette::ConvertToRGBA(&screenData[y * 320], &rgbaData[y * 320], 320);
+            bytesUploaded += 320;
+        }
+    }
+
+    for (int i = 0; i < 320 * 200; ++i)
+        videoHash = HashValue(videoHash, rgbaData[i]);
+
+    // Frames are stored bottom-up for the GL texture, write them as top-down raw RGBA
+    if (videoFile)
+    {
+        for (int y = 199; y >= 0; --y)
+            fwrite(&rgbaData[y * 320], sizeof(unsigned), 320, videoFile);
+    }
+}
+
+unsigned Screen::BytesUploaded()
+{
+    return bytesUploaded;
+}